@@ -13,12 +13,77 @@
  * @brief A single battery history entry
  */
 struct __attribute__((packed)) zmk_battery_history_entry {
-    uint16_t timestamp;    // Seconds since boot (resets on each restart)
+    uint32_t timestamp;    // Seconds on the history timeline, continuing across reboots
     uint8_t battery_level; // Battery percentage (0-100)
 };
 
+/**
+ * @brief A consolidated row of a battery history archive tier
+ */
+struct __attribute__((packed)) zmk_battery_history_archive_row {
+    uint16_t minutes;  // Time covered by the row (0 = lost row)
+    uint8_t min_level; // Lowest battery percentage within the row
+    uint8_t avg_level; // Time-weighted average battery percentage
+    uint8_t max_level; // Highest battery percentage within the row
+};
+
+/**
+ * @brief Flash wear and save cost counters
+ * Kept across reboots with CONFIG_ZMK_BATTERY_HISTORY_PERSIST_STATS.
+ */
+struct zmk_battery_history_storage_stats {
+    uint32_t saves;           // Saves that wrote to storage
+    uint32_t failed_saves;    // Saves that failed with an error
+    uint32_t records_written; // Storage records written
+    uint32_t bytes_written;   // Payload bytes written by the history
+    uint32_t recoveries;      // Boots that discarded corrupt records and kept the rest
+    uint32_t min_save_us;     // Fastest save, 0 without saves
+    uint32_t avg_save_us;
+    uint32_t max_save_us;
+    uint32_t max_sleep_us; // Longest time the history held up entering sleep
+    uint32_t wakeups;      // Work items the module ran since boot
+};
+
+/**
+ * @brief Cause of the reset that started a boot session
+ */
+enum zmk_battery_history_boot_reason {
+    ZMK_BATTERY_HISTORY_BOOT_REASON_UNKNOWN = 0,
+    ZMK_BATTERY_HISTORY_BOOT_REASON_POWER_ON,
+    ZMK_BATTERY_HISTORY_BOOT_REASON_PIN,
+    ZMK_BATTERY_HISTORY_BOOT_REASON_SOFTWARE,
+    ZMK_BATTERY_HISTORY_BOOT_REASON_WATCHDOG,
+    ZMK_BATTERY_HISTORY_BOOT_REASON_BROWNOUT,
+    ZMK_BATTERY_HISTORY_BOOT_REASON_SLEEP_WAKE,
+    ZMK_BATTERY_HISTORY_BOOT_REASON_OTHER,
+};
+
+/**
+ * @brief A boot session, kept with CONFIG_ZMK_BATTERY_HISTORY_SESSIONS
+ */
+struct __attribute__((packed)) zmk_battery_history_session {
+    uint32_t start;        // Seconds on the history timeline when the session booted
+    uint32_t uptime;       // Seconds the session ran, as of its end
+    uint32_t prior_uptime; // Seconds all earlier sessions ran
+    uint32_t boot;         // Boot number, counting from 1
+    uint8_t reason;        // enum zmk_battery_history_boot_reason
+    uint8_t last_level;    // Battery percentage as of its end
+};
+
+/**
+ * @brief A filtered battery voltage sample, kept with
+ * CONFIG_ZMK_BATTERY_HISTORY_MILLIVOLTS
+ */
+struct __attribute__((packed)) zmk_battery_history_voltage_sample {
+    uint32_t timestamp;  // Seconds on the history timeline
+    uint16_t millivolts; // Battery voltage after the on-device filter
+};
+
 /**
  * @brief Get the number of stored battery history entries
+ * With CONFIG_ZMK_BATTERY_HISTORY_LAZY_LOAD, the first call loads the entries
+ * left in storage on the system work queue and waits up to a second for it, so
+ * it must not be called from that queue.
  * @return Number of entries currently stored
  */
 int zmk_battery_history_get_count(void);
@@ -43,9 +108,17 @@ int zmk_battery_history_get_current_level(void);
  */
 int zmk_battery_history_clear(void);
 
+/**
+ * @brief Get the number of corrupt storage records discarded while loading
+ * @return Number of records that failed their checksum at boot
+ */
+int zmk_battery_history_get_discarded_count(void);
+
 /**
  * @brief Get the recording interval in minutes
- * @return Recording interval in minutes
+ * With the adaptive interval or in the low-battery emergency mode this is the
+ * delay of the last scheduled periodic recording.
+ * @return Recording interval in minutes, rounded and at least 1
  */
 int zmk_battery_history_get_interval(void);
 
@@ -57,6 +130,86 @@ int zmk_battery_history_get_max_entries(void);
 
 /**
  * @brief Force save current entries to persistent storage
- * @return 0 on success, negative error code on failure
+ *
+ * Only the battery history settings records that changed are written. With
+ * CONFIG_ZMK_BATTERY_HISTORY_SAVE_BUDGET, a save beyond the budget is
+ * deferred until the budget allows it and 0 is returned.
+ *
+ * @return Number of settings records written, or negative error code on failure
  */
 int zmk_battery_history_save(void);
+
+/**
+ * @brief Get the flash wear and save cost counters
+ * @param stats Pointer to store the counters
+ */
+void zmk_battery_history_get_storage_stats(struct zmk_battery_history_storage_stats *stats);
+
+/**
+ * @brief Get the number of kept boot sessions
+ *
+ * Requires CONFIG_ZMK_BATTERY_HISTORY_SESSIONS. The newest session is the
+ * current one once the history is loaded.
+ *
+ * @return Number of sessions
+ */
+int zmk_battery_history_get_session_count(void);
+
+/**
+ * @brief Get a boot session
+ * @param index Index of the session (0 = oldest)
+ * @param session Pointer to store the session
+ * @return 0 on success, negative error code on failure
+ */
+int zmk_battery_history_get_session(int index, struct zmk_battery_history_session *session);
+
+/**
+ * @brief Get the number of kept voltage samples
+ *
+ * Requires CONFIG_ZMK_BATTERY_HISTORY_MILLIVOLTS.
+ *
+ * @return Number of samples
+ */
+int zmk_battery_history_get_voltage_count(void);
+
+/**
+ * @brief Get a voltage sample
+ * @param index Index of the sample (0 = oldest)
+ * @param sample Pointer to store the sample
+ * @return 0 on success, negative error code on failure
+ */
+int zmk_battery_history_get_voltage_sample(int index,
+                                           struct zmk_battery_history_voltage_sample *sample);
+
+/**
+ * @brief Get the number of archive tiers
+ *
+ * Requires CONFIG_ZMK_BATTERY_HISTORY_ARCHIVE. Tier 0 is the finest one.
+ *
+ * @return Number of tiers
+ */
+int zmk_battery_history_get_archive_tier_count(void);
+
+/**
+ * @brief Get the time covered by a row of an archive tier
+ * @param tier Index of the tier
+ * @return Resolution in minutes, or negative error code
+ */
+int zmk_battery_history_get_archive_resolution(int tier);
+
+/**
+ * @brief Get the number of rows stored in an archive tier
+ * @param tier Index of the tier
+ * @return Number of rows, or negative error code
+ */
+int zmk_battery_history_get_archive_row_count(int tier);
+
+/**
+ * @brief Get a row of an archive tier
+ * @param tier Index of the tier
+ * @param index Index of the row (0 = oldest)
+ * @param row Pointer to store the row
+ * @return 0 on success, negative error code on failure
+ */
+int zmk_battery_history_get_archive_row(int tier, int index,
+                                        struct zmk_battery_history_archive_row *row);
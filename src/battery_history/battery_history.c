@@ -4,13 +4,13 @@
  * SPDX-License-Identifier: MIT
  */
 
-#include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 #include <zephyr/init.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
-#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+#include <zmk/activity.h>
 #include <zmk/battery.h>
 #include <zmk/usb.h>
 #include <zmk/battery_history/battery_history.h>
@@ -18,9 +18,38 @@
 #include <zmk/events/activity_state_changed.h>
 #include <zmk/events/battery_state_changed.h>
 
+#include "battery_history_backend.h"
+#include "battery_history_epoch.h"
+#include "battery_history_stats.h"
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_COMPACT_RAM
+#include "battery_history_compact.h"
+#endif
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_ARCHIVE
+#include "battery_history_archive.h"
+#endif
+#if CONFIG_ZMK_BATTERY_HISTORY_SAVE_BUDGET > 0
+#include "battery_history_budget.h"
+#endif
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_ADAPTIVE_INTERVAL
+#include "battery_history_interval.h"
+#endif
+#if CONFIG_ZMK_BATTERY_HISTORY_FILTER_DEADBAND > 0
+#include "battery_history_filter.h"
+#endif
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_SLEEP_RECORD
+#include "battery_history_sleep.h"
+#endif
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_SESSIONS
+#include "battery_history_sessions.h"
+#endif
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_MILLIVOLTS
+#include "battery_history_millivolts.h"
+#endif
+
 LOG_MODULE_REGISTER(zmk_battery_history, CONFIG_ZMK_LOG_LEVEL);
 
 #define MAX_ENTRIES CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES
+#define RING_ENTRIES BATTERY_HISTORY_RING_ENTRIES
 #define RECORDING_INTERVAL_MS (CONFIG_ZMK_BATTERY_HISTORY_INTERVAL_MINUTES * 60 * 1000)
 #define SAVE_INTERVAL_SEC (CONFIG_ZMK_BATTERY_HISTORY_SAVE_INTERVAL_MINUTES * 60)
 #define SAVE_LEVEL_THRESHOLD CONFIG_ZMK_BATTERY_HISTORY_SAVE_LEVEL_THRESHOLD
@@ -31,48 +60,189 @@ LOG_MODULE_REGISTER(zmk_battery_history, CONFIG_ZMK_LOG_LEVEL);
 // minutes have passed
 #define MIN_SAME_LEVEL_INTERVAL_SEC (CONFIG_ZMK_BATTERY_HISTORY_INTERVAL_MINUTES * 60 * 4)
 
-// Circular buffer for battery history
-static struct zmk_battery_history_entry history_buffer[MAX_ENTRIES];
+#ifndef CONFIG_ZMK_BATTERY_HISTORY_COMPACT_RAM
+// Longest time a history request waits for the deferred entries to load
+#define LOAD_TIMEOUT_MS 1000
+
+// Largest timestamp offset a ring entry holds, about 194 days
+#define RING_OFFSET_MAX BIT_MASK(24)
+
+/**
+ * Entry as kept in RAM, its timestamp an offset from ring_base, widened to a
+ * struct zmk_battery_history_entry whenever it is read
+ */
+struct ring_entry {
+    uint16_t offset_low;
+    uint8_t offset_high;
+    uint8_t battery_level;
+} __packed;
+
+// Circular buffer for battery history, only staging entries for storage in
+// flash-only mode
+static struct ring_entry history_buffer[RING_ENTRIES];
+// Timestamp the entry offsets count from
+static uint32_t ring_base = 0;
+#endif
 static int history_head = 0;  // Index of the oldest entry
 static int history_count = 0; // Number of valid entries
 static int unsaved_count = 0; // Number of entries not yet saved to flash
 
-// Track which entries need saving (for incremental saves)
-// We track the index of the first unsaved entry
-static int first_unsaved_idx = -1;
+// Whether appended entries still have to be committed by the backend
+static bool flush_pending = false;
+
+// Number of oldest ring entries the backend has not restored yet
+static int unloaded_count = 0;
+
+// Number of corrupt storage units discarded while loading
+static int discarded_count = 0;
 
 // Battery level at last save (for threshold-based saving)
 static uint8_t last_saved_battery_level = 100;
-static uint16_t last_saved_timestamp = 0;
+static uint32_t last_saved_uptime = 0;
 
 // Work item for periodic recording
 static void battery_history_work_handler(struct k_work *work);
 K_WORK_DELAYABLE_DEFINE(battery_history_work, battery_history_work_handler);
 
+#if CONFIG_ZMK_BATTERY_HISTORY_SAVE_BUDGET > 0
+// Flash saves allowed by the configured budget
+static struct battery_history_budget save_budget;
+
+// Work item running a save deferred by the budget
+static void battery_history_save_work_handler(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(battery_history_save_work, battery_history_save_work_handler);
+#endif
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_ADAPTIVE_INTERVAL
+// Recording interval following the drain rate
+static struct battery_history_interval recording_interval;
+#endif
+
+#if CONFIG_ZMK_BATTERY_HISTORY_FILTER_DEADBAND > 0
+// Hysteresis against readings bouncing between two levels
+static struct battery_history_filter level_filter;
+#endif
+
+// Work item recording the level reported by battery events
+static void battery_history_sample_work_handler(struct k_work *work);
+K_WORK_DEFINE(battery_history_sample_work, battery_history_sample_work_handler);
+
+// Level of the last battery event not yet recorded, negative if none
+static atomic_t reported_level = ATOMIC_INIT(-1);
+
+// Uptime the next periodic recording is due
+static int64_t next_recording_ms = 0;
+// Delay of the last scheduled periodic recording
+static int recording_interval_ms = RECORDING_INTERVAL_MS;
+// Work items run by the module since boot
+static uint32_t wakeup_count = 0;
+
+// Work item restoring deferred entries while the keyboard is idle
+static void battery_history_load_work_handler(struct k_work *work);
+K_WORK_DEFINE(battery_history_load_work, battery_history_load_work_handler);
+// Given each time the load work item finished
+static K_SEM_DEFINE(load_done_sem, 0, 1);
+
 // Current battery level cache
 static uint8_t current_battery_level = 0;
 // Track if initialization is done, meaning settings have been loaded
 static bool initialization_done = false;
 
+#ifndef CONFIG_ZMK_BATTERY_HISTORY_SESSIONS
 // Track if this is the first record after boot
 static bool first_record_after_boot = true;
+#endif
 
-// Track if head has changed since last save (requires full save)
-static bool head_changed_since_save = false;
-
-// Settings handling
-static int battery_history_settings_set(const char *name, size_t len, settings_read_cb read_cb,
-                                        void *cb_arg);
-static int battery_history_settings_commit(void);
+#if CONFIG_ZMK_BATTERY_HISTORY_EMERGENCY_LEVEL > 0
+// Whether the battery is nearly depleted, every entry is written right away
+static bool emergency_mode = false;
+#endif
 
-SETTINGS_STATIC_HANDLER_DEFINE(battery_history, "battery_history", NULL,
-                               battery_history_settings_set, battery_history_settings_commit, NULL);
+/**
+ * Whether the stored history is restored and recording may start
+ */
+static bool history_ready(void) {
+    // New entries are timestamped after every stored one
+    if (!initialization_done || !battery_history_epoch_loaded()) {
+        return false;
+    }
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_SLEEP_RECORD
+    // Entries written before the last sleep come before any new one
+    return battery_history_sleep_restored();
+#else
+    return true;
+#endif
+}
 
+#ifndef CONFIG_ZMK_BATTERY_HISTORY_COMPACT_RAM
 /**
  * Get the absolute index in the circular buffer
  */
 static int get_buffer_index(int logical_index) {
-    return (history_head + logical_index) % MAX_ENTRIES;
+    return (history_head + logical_index) % RING_ENTRIES;
+}
+
+static uint32_t get_slot_timestamp(int slot) {
+    const struct ring_entry *ring_entry = &history_buffer[slot];
+
+    return ring_base + (ring_entry->offset_low | (uint32_t)ring_entry->offset_high << 16);
+}
+
+static void read_slot(int slot, struct zmk_battery_history_entry *entry) {
+    entry->timestamp = get_slot_timestamp(slot);
+    entry->battery_level = history_buffer[slot].battery_level;
+}
+
+/**
+ * Move ring_base so the timestamp fits, keeping the other entries in place
+ */
+static void rebase_ring(uint32_t timestamp) {
+    uint32_t base;
+
+    if (timestamp < ring_base) {
+        // Restored after newer entries
+        base = timestamp;
+    } else if (history_count > 0 &&
+               timestamp - get_slot_timestamp(history_head) <= RING_OFFSET_MAX) {
+        base = get_slot_timestamp(history_head);
+    } else {
+        // Entries further back are clamped, they span more than the offsets
+        base = timestamp - MIN(timestamp, RING_OFFSET_MAX / 2);
+    }
+
+    for (int slot = 0; slot < RING_ENTRIES; slot++) {
+        uint32_t slot_timestamp = get_slot_timestamp(slot);
+        uint32_t offset = slot_timestamp < base ? 0 : MIN(slot_timestamp - base, RING_OFFSET_MAX);
+
+        history_buffer[slot].offset_low = (uint16_t)offset;
+        history_buffer[slot].offset_high = (uint8_t)(offset >> 16);
+    }
+    ring_base = base;
+}
+
+static void write_slot(int slot, uint32_t timestamp, uint8_t level) {
+    if (timestamp < ring_base || timestamp - ring_base > RING_OFFSET_MAX) {
+        rebase_ring(timestamp);
+    }
+    uint32_t offset = MIN(timestamp - ring_base, RING_OFFSET_MAX);
+
+    history_buffer[slot] = (struct ring_entry){
+        .offset_low = (uint16_t)offset,
+        .offset_high = (uint8_t)(offset >> 16),
+        .battery_level = level,
+    };
+}
+#endif
+
+/**
+ * Read an entry by logical index (0 = oldest)
+ */
+static void read_history_entry(int logical_index, struct zmk_battery_history_entry *entry) {
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_COMPACT_RAM
+    battery_history_compact_get(logical_index, entry);
+#else
+    read_slot(get_buffer_index(logical_index), entry);
+#endif
 }
 
 /**
@@ -82,128 +252,289 @@ static bool get_last_entry(struct zmk_battery_history_entry *entry) {
     if (history_count == 0) {
         return false;
     }
-    int last_idx = get_buffer_index(history_count - 1);
-    *entry = history_buffer[last_idx];
+    read_history_entry(history_count - 1, entry);
     return true;
 }
 
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_COMPACT_RAM
 /**
- * Add a new entry to the history buffer
+ * Push an entry to the end of the compact ring, which drops as many old
+ * entries as needed to make room for it
  */
-static void add_history_entry(uint16_t timestamp, uint8_t level) {
+static void push_history_entry(uint32_t timestamp, uint8_t level) {
+    struct zmk_battery_history_entry entry = {
+        .timestamp = timestamp,
+        .battery_level = level,
+    };
+    battery_history_compact_push(&entry);
+    history_count = battery_history_compact_count();
+}
+#else
+/**
+ * Push an entry to the end of the history buffer, dropping the oldest entry
+ * when the buffer is full
+ */
+static void push_history_entry(uint32_t timestamp, uint8_t level) {
     int write_idx;
 
-    if (history_count < MAX_ENTRIES) {
+    if (history_count < RING_ENTRIES) {
         // Buffer not full, append at end
-        write_idx = (history_head + history_count) % MAX_ENTRIES;
+        write_idx = (history_head + history_count) % RING_ENTRIES;
         history_count++;
     } else {
         // Buffer full, overwrite oldest entry
         write_idx = history_head;
-        history_head = (history_head + 1) % MAX_ENTRIES;
-        head_changed_since_save = true;
+        history_head = (history_head + 1) % RING_ENTRIES;
     }
 
-    history_buffer[write_idx].timestamp = timestamp;
-    history_buffer[write_idx].battery_level = level;
+    write_slot(write_idx, timestamp, level);
+}
+#endif
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_ARCHIVE
+// A single push drops at most three entries (an escape entry of the compact ring)
+#define MAX_DROPPED_PER_PUSH 3
+#endif
 
-    // Track first unsaved entry index
-    if (first_unsaved_idx < 0) {
-        first_unsaved_idx = write_idx;
+static int save_history(bool urgent);
+
+/**
+ * Restore the entries left in storage at boot, before they are first read or
+ * dropped from the ring
+ */
+static void ensure_entries_loaded(void) {
+    if (unloaded_count == 0) {
+        return;
     }
-    unsaved_count++;
 
-    LOG_DBG("Added battery history entry: timestamp=%u, level=%u, idx=%d "
-            "(total=%d, unsaved=%d)",
-            timestamp, level, write_idx, history_count, unsaved_count);
+    int dropped = battery_history_backend.load_entries(unloaded_count);
+    if (dropped < 0) {
+        // Never serve or archive slots that were not restored
+        dropped = unloaded_count;
+    }
+    unloaded_count = 0;
+
+    if (dropped > 0) {
+        LOG_WRN("Dropping %d battery history entries that could not be loaded", dropped);
+        history_head = (history_head + dropped) % RING_ENTRIES;
+        history_count -= dropped;
+    }
 }
 
 /**
- * Set a single entry in settings (without immediate flush)
+ * Add a new entry to the history buffer
  */
-static int set_single_entry(int buffer_idx) {
-    char key[32];
-    snprintf(key, sizeof(key), "battery_history/e%d", buffer_idx);
+static void add_history_entry(uint32_t timestamp, uint8_t level) {
+    if (history_count >= RING_ENTRIES) {
+        // The push drops the oldest entry
+        ensure_entries_loaded();
+    }
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_FLASH_ONLY
+    if (unsaved_count >= RING_ENTRIES) {
+        // The staged entries exist nowhere else, write them before the push
+        // drops one
+        save_history(true);
+    }
+#endif
 
-    int rc = settings_runtime_set(key, &history_buffer[buffer_idx],
-                                  sizeof(struct zmk_battery_history_entry));
-    if (rc < 0) {
-        LOG_ERR("Failed to set entry %d: %d", buffer_idx, rc);
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_ARCHIVE
+    // Keep the oldest entries, the push may drop them
+    struct zmk_battery_history_entry oldest[MAX_DROPPED_PER_PUSH];
+    int count_before = history_count;
+    for (int i = 0; i < MIN(count_before, MAX_DROPPED_PER_PUSH); i++) {
+        read_history_entry(i, &oldest[i]);
     }
-    return rc;
+#endif
+
+    push_history_entry(timestamp, level);
+    unsaved_count++;
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_ARCHIVE
+    // Entries dropped from the ring live on in the consolidated archive
+    for (int i = 0; i < count_before + 1 - history_count; i++) {
+        battery_history_archive_add(&oldest[i]);
+    }
+#endif
+
+    LOG_DBG("Added battery history entry: timestamp=%u, level=%u (total=%d, unsaved=%d)",
+            timestamp, level, history_count, unsaved_count);
 }
 
 /**
- * Save history to persistent storage (incremental save)
- * Uses settings_runtime_set for each item, then a single flush at the end
+ * Hand the entries added since the last save to the backend
+ * Returns the number of records written or a negative error code
  */
-static int save_history(void) {
-    if (!initialization_done) {
-        LOG_WRN("Settings not loaded yet, skipping battery history save");
-        return 0;
-    }
-    if (unsaved_count == 0) {
-        return 0;
+static int append_unsaved_entries(void) {
+    // Unsaved entries are always the newest ones still in the ring
+    int remaining = MIN(unsaved_count, history_count);
+    int logical_index = history_count - remaining;
+    int written = 0;
+
+    while (remaining > 0) {
+        struct zmk_battery_history_entry entries[16];
+        int n = MIN(remaining, (int)ARRAY_SIZE(entries));
+
+        for (int i = 0; i < n; i++) {
+            read_history_entry(logical_index + i, &entries[i]);
+        }
+        int rc = battery_history_backend.append(logical_index, entries, n);
+        if (rc < 0) {
+            return rc;
+        }
+        written += rc;
+        logical_index += n;
+        remaining -= n;
+        // Do not append the same entries again if a later batch fails
+        unsaved_count = remaining;
+        flush_pending = true;
     }
-    // TODO: take locks
-    LOG_INF("Saving battery history to flash (count=%d, unsaved=%d, "
-            "head_changed=%d)",
-            history_count, unsaved_count, head_changed_since_save);
+    return written;
+}
 
-    int rc;
+/**
+ * Hand the unsaved entries to the backend and commit them
+ * Returns the number of records written or a negative error code
+ */
+static int store_unsaved_entries(void) {
+    // TODO: take locks
+    LOG_INF("Saving battery history to flash (count=%d, unsaved=%d)", history_count,
+            unsaved_count);
 
-    // Set head and count (small data, always needed)
-    rc = settings_runtime_set("battery_history/head", &history_head, sizeof(history_head));
+    int rc = battery_history_epoch_reserve();
     if (rc < 0) {
-        LOG_ERR("Failed to set history head: %d", rc);
         return rc;
     }
-
-    rc = settings_runtime_set("battery_history/count", &history_count, sizeof(history_count));
+    rc = append_unsaved_entries();
     if (rc < 0) {
-        LOG_ERR("Failed to set history count: %d", rc);
         return rc;
     }
+    int written = rc;
 
-    // Set only the entries that have changed
-    // Note that since zephyr skips unchanged entries during settings_save(),
-    // tracking which entries changed is not strictly necessary?
-    if (first_unsaved_idx >= 0) {
-        int entries_to_save = unsaved_count;
-        int idx = first_unsaved_idx;
-
-        LOG_DBG("Incremental save: %d entries starting from idx %d", entries_to_save, idx);
-
-        for (int i = 0; i < entries_to_save; i++) {
-            rc = set_single_entry(idx);
-            if (rc < 0) {
-                return rc;
-            }
-            idx = (idx + 1) % MAX_ENTRIES;
+    if (flush_pending && battery_history_backend.flush != NULL) {
+        rc = battery_history_backend.flush();
+        if (rc < 0) {
+            return rc;
         }
+        written += rc;
     }
+    flush_pending = false;
 
-    // Single flush to commit all changes to storage
-    rc = settings_save();
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_ARCHIVE
+    rc = battery_history_archive_save();
     if (rc < 0) {
-        LOG_ERR("Failed to flush settings: %d", rc);
         return rc;
     }
-    first_unsaved_idx = -1;
+    written += rc;
+#endif
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_MILLIVOLTS
+    rc = battery_history_millivolts_save();
+    if (rc < 0) {
+        return rc;
+    }
+    written += rc;
+#endif
+
     unsaved_count = 0;
-    head_changed_since_save = false;
     last_saved_battery_level = current_battery_level;
-    last_saved_timestamp = k_uptime_get() / 1000;
+    last_saved_uptime = k_uptime_get() / 1000;
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_SLEEP_RECORD
+    // Entries of the sleep record are saved now, never restore them again
+    battery_history_sleep_clear();
+#endif
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_SESSIONS
+    battery_history_sessions_update(current_battery_level);
+#endif
 
-    LOG_INF("Battery history saved successfully (incremental)");
-    return 0;
+    LOG_INF("Battery history saved successfully (%d records)", written);
+    return written;
+}
+
+/**
+ * Write the unsaved entries, accounting the cost of the save
+ * Returns the number of records written or a negative error code
+ */
+static int write_history(void) {
+    struct battery_history_backend_stats before, after;
+
+    if (unsaved_count == 0 && !flush_pending) {
+        return 0;
+    }
+    battery_history_backend.get_stats(&before);
+    uint32_t start = k_cycle_get_32();
+
+    int rc = store_unsaved_entries();
+
+    uint32_t save_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    battery_history_backend.get_stats(&after);
+    battery_history_stats_add_save(rc, after.bytes_written - before.bytes_written, save_us);
+    return rc;
+}
+
+/**
+ * Save history to persistent storage (incremental save)
+ * Only the entries added since the last save are handed to the backend.
+ * Saves beyond the budget are deferred, urgent ones may overdraw it and
+ * fail with -EBUSY beyond that.
+ * Returns the number of records written or a negative error code
+ */
+static int save_history(bool urgent) {
+    if (!initialization_done) {
+        LOG_WRN("Settings not loaded yet, skipping battery history save");
+        return 0;
+    }
+#if CONFIG_ZMK_BATTERY_HISTORY_SAVE_BUDGET > 0
+    if (unsaved_count == 0 && !flush_pending) {
+        return 0;
+    }
+    int64_t wait_ms = battery_history_budget_take(&save_budget, k_uptime_get(), urgent);
+    if (wait_ms > 0) {
+        // Everything unsaved by then is written by a single save
+        k_work_schedule(&battery_history_save_work, K_MSEC(wait_ms));
+        if (urgent) {
+            LOG_WRN("Save budget overdrawn, deferring urgent battery history save");
+            return -EBUSY;
+        }
+        LOG_DBG("Save budget exhausted, deferring battery history save by %lld ms", wait_ms);
+        return 0;
+    }
+#endif
+    return write_history();
 }
 
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_FORCE_SAVE_ON_SLEEP
+/**
+ * Save the unsaved entries at a bounded cost, e.g. before sleep
+ * With the sleep record they are written as a single fixed-size record, and
+ * handed to the backend later. A full save is only needed when they do not
+ * fit.
+ */
+static void save_bounded(void) {
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_SLEEP_RECORD
+    int count = MIN(unsaved_count, history_count);
+
+    // Entries appended to the backend but not committed are not in the ring
+    if (!flush_pending && count <= CONFIG_ZMK_BATTERY_HISTORY_SLEEP_RECORD_ENTRIES) {
+        struct zmk_battery_history_entry entries[CONFIG_ZMK_BATTERY_HISTORY_SLEEP_RECORD_ENTRIES];
+
+        for (int i = 0; i < count; i++) {
+            read_history_entry(history_count - count + i, &entries[i]);
+        }
+        if (battery_history_epoch_reserve() == 0 &&
+            battery_history_sleep_save(entries, count) == 0) {
+            return;
+        }
+    }
+    LOG_DBG("Battery history does not fit the sleep record, saving it in full");
+#endif
+    save_history(true);
+}
+#endif
+
 /**
  * Check if we should save based on battery level drop
  * Returns true if battery has dropped by threshold since last save
  */
-static bool should_save_entries(uint16_t timestamp, uint8_t current_battery_level) {
+static bool should_save_entries(uint8_t current_battery_level) {
     uint8_t level_gap = last_saved_battery_level > current_battery_level
                             ? last_saved_battery_level - current_battery_level
                             : current_battery_level - last_saved_battery_level;
@@ -211,7 +542,7 @@ static bool should_save_entries(uint16_t timestamp, uint8_t current_battery_leve
         LOG_DBG("Save triggered by level threshold");
         return true;
     }
-    uint16_t time_gap = timestamp - last_saved_timestamp;
+    uint32_t time_gap = k_uptime_get() / 1000 - last_saved_uptime;
     if (time_gap >= SAVE_INTERVAL_SEC) {
         LOG_DBG("Save triggered by time threshold");
         return true;
@@ -224,19 +555,21 @@ static bool should_save_entries(uint16_t timestamp, uint8_t current_battery_leve
  * Check if we should record based on battery level change
  * Returns true if we should add a new entry
  */
-static bool should_record_entry(uint16_t timestamp, uint8_t level) {
+static bool should_record_entry(uint32_t timestamp, uint8_t level) {
 #ifdef CONFIG_ZMK_BATTERY_SKIP_IF_USB_POWERED
     if (zmk_usb_is_powered()) {
         LOG_DBG("USB powered, skipping battery history record");
         return false;
     }
 #endif
+#ifndef CONFIG_ZMK_BATTERY_HISTORY_SESSIONS
     // Always record the first entry after boot
     if (first_record_after_boot) {
         first_record_after_boot = false;
         LOG_DBG("Recording first entry after boot");
         return true;
     }
+#endif
 
     // Get the last recorded entry
     struct zmk_battery_history_entry last_entry;
@@ -263,9 +596,13 @@ static bool should_record_entry(uint16_t timestamp, uint8_t level) {
 
     // If level is the same, only record if enough time has passed
     // This reduces redundant entries when battery is stable
-    // Note: Since timestamp resets on boot, wrap-around is not a concern here
-    // as we always record first entry after boot
-    uint16_t time_diff = timestamp - last_entry.timestamp;
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_SESSIONS
+    // The session record marks the boot, an unchanged level right after it
+    // adds nothing
+    uint32_t time_diff = timestamp - MAX(last_entry.timestamp, battery_history_epoch_boot());
+#else
+    uint32_t time_diff = timestamp - last_entry.timestamp;
+#endif
     if (time_diff >= MIN_SAME_LEVEL_INTERVAL_SEC) {
         LOG_DBG("Recording entry: time threshold passed (%u sec)", time_diff);
         return true;
@@ -276,19 +613,56 @@ static bool should_record_entry(uint16_t timestamp, uint8_t level) {
     return false;
 }
 
+#if CONFIG_ZMK_BATTERY_HISTORY_EMERGENCY_LEVEL > 0
 /**
- * Record current battery level to history
+ * Enter or leave the low-battery emergency mode
  */
-static void record_battery_level() {
-    if (!initialization_done) {
+static void update_emergency_mode(void) {
+    bool low = current_battery_level <= CONFIG_ZMK_BATTERY_HISTORY_EMERGENCY_LEVEL;
+#ifdef CONFIG_ZMK_BATTERY_SKIP_IF_USB_POWERED
+    // Charging, nothing is recorded anyway
+    low = low && !zmk_usb_is_powered();
+#endif
+    if (low != emergency_mode) {
+        LOG_INF("Battery history %s low-battery emergency mode at %d%%",
+                low ? "entering" : "leaving", current_battery_level);
+        emergency_mode = low;
+    }
+}
+#endif
+
+/**
+ * Get the delay until the next periodic recording
+ */
+static int get_recording_interval_ms(void) {
+#if CONFIG_ZMK_BATTERY_HISTORY_EMERGENCY_LEVEL > 0
+    if (emergency_mode) {
+        // Every entry costs a write now, sample less often
+        return CONFIG_ZMK_BATTERY_HISTORY_EMERGENCY_INTERVAL_MINUTES * 60 * 1000;
+    }
+#endif
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_ADAPTIVE_INTERVAL
+    return (int)battery_history_interval_next(&recording_interval, k_uptime_get(),
+                                              current_battery_level);
+#else
+    return RECORDING_INTERVAL_MS;
+#endif
+}
+
+/**
+ * Record a battery level sample to history, whether read by the timer or
+ * reported by a battery event
+ * @param level Battery level, or negative error code of the read
+ * @param save Save to flash when the level or time threshold is reached
+ */
+static void record_battery_level(int level, bool save) {
+    if (!history_ready()) {
         LOG_WRN("Settings not loaded yet, skipping battery record");
         return;
     }
-    // Get current timestamp (seconds since boot)
-    uint16_t timestamp = (uint16_t)(k_uptime_get() / 1000);
+    // Get current timestamp (seconds on the timeline, continuing across reboots)
+    uint32_t timestamp = battery_history_epoch_now();
 
-    // Get current battery level
-    int level = zmk_battery_state_of_charge();
     if (level < 0) {
         LOG_WRN("Failed to get battery level: %d", level);
         return;
@@ -300,85 +674,205 @@ static void record_battery_level() {
         return;
     }
 #endif
+#if CONFIG_ZMK_BATTERY_HISTORY_FILTER_DEADBAND > 0
+#ifdef CONFIG_USB_DEVICE_STACK
+    bool charging = zmk_usb_is_powered();
+#else
+    bool charging = false;
+#endif
+    int reading = level;
+    level = battery_history_filter_update(&level_filter, k_uptime_get(), reading, charging);
+    if (level != reading) {
+        LOG_DBG("Holding battery level at %d%%, read %d%%", level, reading);
+    }
+#endif
 
     current_battery_level = (uint8_t)level;
+#if CONFIG_ZMK_BATTERY_HISTORY_EMERGENCY_LEVEL > 0
+    update_emergency_mode();
+#endif
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_SESSIONS
+    battery_history_sessions_start(current_battery_level);
+#endif
 
     // Check if we should add this entry
-    if (!should_record_entry(timestamp, current_battery_level)) {
+    bool record = should_record_entry(timestamp, current_battery_level);
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_MILLIVOLTS
+    // Read along with the level, the voltage takes no wakeups of its own
+    battery_history_millivolts_record(timestamp, record);
+#endif
+    if (!record) {
         return;
     }
 
     add_history_entry(timestamp, current_battery_level);
+    if (!save) {
+        return;
+    }
+#if CONFIG_ZMK_BATTERY_HISTORY_EMERGENCY_LEVEL > 0
+    if (emergency_mode) {
+        // A brown-out may follow any moment, keep every entry
+        save_bounded();
+        return;
+    }
+#endif
 
     // Save to flash if battery level has dropped by threshold
-    if (should_save_entries(timestamp, current_battery_level)) {
-        save_history();
+    if (should_save_entries(current_battery_level)) {
+        save_history(false);
     }
 }
 
+/**
+ * Arm the periodic recording for its due time
+ * Nothing is armed before the history is ready or while the keyboard is idle
+ * or asleep, battery events are still recorded meanwhile.
+ */
+static void schedule_recording(void) {
+    if (!history_ready() || zmk_activity_get_state() != ZMK_ACTIVITY_ACTIVE) {
+        return;
+    }
+    int64_t delay_ms = MAX(next_recording_ms - k_uptime_get(), 0);
+    k_work_schedule(&battery_history_work, K_MSEC(delay_ms));
+}
+
+void battery_history_start_recording(void) { schedule_recording(); }
+
+/**
+ * Work handler recording the level reported by the last battery events
+ */
+static void battery_history_sample_work_handler(struct k_work *work) {
+    wakeup_count++;
+    int level = (int)atomic_set(&reported_level, -1);
+    if (level < 0) {
+        return;
+    }
+    // The periodic schedule is left alone, it does not drift with events
+    record_battery_level(level, true);
+}
+
 /**
  * Work handler for periodic battery recording
  */
 static void battery_history_work_handler(struct k_work *work) {
-    if (!initialization_done) {
-        // Settings not yet loaded, skip recording
-        k_work_schedule(&battery_history_work, K_MSEC(1000));
+    wakeup_count++;
+    if (!history_ready()) {
+        // Started again by battery_history_start_recording()
         return;
     }
-    record_battery_level();
+    record_battery_level(zmk_battery_state_of_charge(), true);
 
     // Schedule next recording
-    k_work_schedule(&battery_history_work, K_MSEC(RECORDING_INTERVAL_MS));
+    recording_interval_ms = get_recording_interval_ms();
+    next_recording_ms = k_uptime_get() + recording_interval_ms;
+    schedule_recording();
 }
 
 /**
- * Settings load handler
+ * Work handler restoring deferred entries
  */
-static int battery_history_settings_set(const char *name, size_t len, settings_read_cb read_cb,
-                                        void *cb_arg) {
-    if (!strcmp(name, "head")) {
-        if (len != sizeof(history_head)) {
-            return -EINVAL;
-        }
-        return read_cb(cb_arg, &history_head, sizeof(history_head));
+static void battery_history_load_work_handler(struct k_work *work) {
+    ensure_entries_loaded();
+    k_sem_give(&load_done_sem);
+}
+
+#if CONFIG_ZMK_BATTERY_HISTORY_SAVE_BUDGET > 0
+/**
+ * Work handler running a save deferred by the budget
+ */
+static void battery_history_save_work_handler(struct k_work *work) {
+    wakeup_count++;
+    save_history(false);
+}
+#endif
+
+/* Ring access for backends */
+
+int battery_history_ring_count(void) { return history_count; }
+
+void battery_history_restore_entry(const struct zmk_battery_history_entry *entry) {
+    push_history_entry(entry->timestamp, entry->battery_level);
+}
+
+void battery_history_import_entry(const struct zmk_battery_history_entry *entry) {
+    // Imported entries exist nowhere else in the active layout, write them
+    // before the push could drop one. An escaped compact entry takes three words.
+    int capacity = IS_ENABLED(CONFIG_ZMK_BATTERY_HISTORY_COMPACT_RAM) ? RING_ENTRIES / 3
+                                                                       : RING_ENTRIES;
+    if (unsaved_count >= capacity) {
+        write_history();
     }
+    push_history_entry(entry->timestamp, entry->battery_level);
+    unsaved_count++;
+}
 
-    if (!strcmp(name, "count")) {
-        if (len != sizeof(history_count)) {
-            return -EINVAL;
-        }
-        return read_cb(cb_arg, &history_count, sizeof(history_count));
+void battery_history_add_entry(const struct zmk_battery_history_entry *entry) {
+    add_history_entry(entry->timestamp, entry->battery_level);
+}
+
+int battery_history_save_now(void) { return save_history(true); }
+
+int battery_history_rewrite(void) {
+    if (!initialization_done) {
+        return -EAGAIN;
     }
+    ensure_entries_loaded();
+    // Every entry in the ring is handed to the backend again
+    unsaved_count = history_count;
+    return save_history(true);
+}
 
-    // individual entries with "eN" keys
-    if (name[0] == 'e') {
-        int idx = atoi(name + 1);
-        if (idx >= 0 && idx < MAX_ENTRIES) {
-            if (len != sizeof(struct zmk_battery_history_entry)) {
-                return -EINVAL;
-            }
-            return read_cb(cb_arg, &history_buffer[idx], sizeof(struct zmk_battery_history_entry));
-        }
+#ifndef CONFIG_ZMK_BATTERY_HISTORY_COMPACT_RAM
+int battery_history_ring_head(void) { return history_head; }
+
+void battery_history_ring_read_slot(int slot, struct zmk_battery_history_entry *entry) {
+    read_slot(slot, entry);
+}
+
+void battery_history_restore_slot(int slot, const struct zmk_battery_history_entry *entry) {
+    // Slots past the deferred entries already hold entries recorded since boot
+    if (initialization_done &&
+        (slot - history_head + RING_ENTRIES) % RING_ENTRIES >= unloaded_count) {
+        return;
     }
+    write_slot(slot, entry->timestamp, entry->battery_level);
+}
+
+void battery_history_restore_ring(int head, int count) {
+    history_head = head;
+    history_count = count;
+}
+#endif
 
-    return -ENOENT;
+void battery_history_count_discarded(void) {
+    if (discarded_count++ == 0) {
+        // The rest of the history is kept, count this as a recovery once
+        battery_history_stats_add_recovery();
+    }
 }
 
 /**
- * Settings commit handler - called after all settings are loaded
+ * Mark stored history as loaded and derive the save state from it
  */
-static int battery_history_settings_commit(void) {
-    LOG_INF("Battery history loaded: count=%d, head=%d", history_count, history_head);
-    // Initialize last_saved_battery_level from the most recent entry if
-    // available
+void battery_history_restore_done(void) {
+    LOG_INF("Battery history loaded: count=%d, head=%d, discarded=%d", history_count,
+            history_head, discarded_count);
+    if (battery_history_backend.load_entries != NULL && history_count > 0) {
+        // Only the newest entry is restored, the others stay in storage
+        unloaded_count = history_count - 1;
+    }
+    // Initialize last_saved_battery_level from the most recent entry if available
     struct zmk_battery_history_entry last_entry;
     if (get_last_entry(&last_entry)) {
         last_saved_battery_level = last_entry.battery_level;
-        // Note: last_saved_timestamp is not restored from storage since timestamp
-        // resets on boot
+        // Even if the stored epoch was lost, new entries come after this one
+        battery_history_epoch_advance(last_entry.timestamp);
     }
     initialization_done = true;
-    return 0;
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_SLEEP_RECORD
+    battery_history_sleep_restore();
+#endif
+    battery_history_start_recording();
 }
 
 /**
@@ -386,8 +880,9 @@ static int battery_history_settings_commit(void) {
  */
 static int battery_history_event_listener(const zmk_event_t *eh) {
     const struct zmk_battery_state_changed *bev = as_zmk_battery_state_changed(eh);
-    if (bev) {
-        k_work_reschedule(&battery_history_work, K_NO_WAIT);
+    // Events coming in before the sample work ran only update its level
+    if (bev && atomic_set(&reported_level, bev->state_of_charge) < 0) {
+        k_work_submit(&battery_history_sample_work);
     }
     return ZMK_EV_EVENT_BUBBLE;
 }
@@ -402,14 +897,36 @@ static int battery_history_activity_listener(const zmk_event_t *eh) {
     const struct zmk_activity_state_changed *aev = as_zmk_activity_state_changed(eh);
     if (aev && aev->state == ZMK_ACTIVITY_SLEEP) {
         LOG_INF("Device entering sleep, saving battery history");
-        // Record current level before sleep
-        record_battery_level();
+        uint32_t start = k_cycle_get_32();
+        // Record current level before sleep, it is saved below
+        record_battery_level(zmk_battery_state_of_charge(), false);
 #ifdef CONFIG_ZMK_BATTERY_HISTORY_FORCE_SAVE_ON_SLEEP
         // Force save any unsaved data
         if (unsaved_count > 0) {
-            save_history();
+            save_bounded();
         }
 #endif
+        uint32_t sleep_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+        LOG_INF("Battery history held up sleep for %u us", sleep_us);
+        battery_history_stats_add_sleep(sleep_us);
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_SESSIONS
+        battery_history_sessions_end(current_battery_level);
+#endif
+        battery_history_stats_flush();
+    } else if (aev && aev->state == ZMK_ACTIVITY_ACTIVE) {
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_SLEEP_RECORD
+        // Woken up without a reboot, the entries are still in the ring
+        battery_history_sleep_wake();
+#endif
+        // Resume periodic recording, a recording due meanwhile runs now
+        schedule_recording();
+    } else if (aev && aev->state == ZMK_ACTIVITY_IDLE && unloaded_count > 0) {
+        // Nobody is typing, a good time to restore deferred entries
+        k_work_submit(&battery_history_load_work);
+    }
+    if (aev && aev->state != ZMK_ACTIVITY_ACTIVE) {
+        // No periodic recording while idle or asleep
+        k_work_cancel_delayable(&battery_history_work);
     }
     return ZMK_EV_EVENT_BUBBLE;
 }
@@ -424,10 +941,46 @@ static int battery_history_init(void) {
     LOG_INF("Initializing battery history module");
     LOG_INF("Max entries: %d, Recording interval: %d minutes, Save level "
             "threshold: %d%%",
-            MAX_ENTRIES, CONFIG_ZMK_BATTERY_HISTORY_INTERVAL_MINUTES, SAVE_LEVEL_THRESHOLD);
+            zmk_battery_history_get_max_entries(), CONFIG_ZMK_BATTERY_HISTORY_INTERVAL_MINUTES,
+            SAVE_LEVEL_THRESHOLD);
+
+#if CONFIG_ZMK_BATTERY_HISTORY_SAVE_BUDGET > 0
+    battery_history_budget_init(&save_budget, CONFIG_ZMK_BATTERY_HISTORY_SAVE_BUDGET,
+                                CONFIG_ZMK_BATTERY_HISTORY_SAVE_BURST, k_uptime_get());
+#endif
+#if CONFIG_ZMK_BATTERY_HISTORY_FILTER_DEADBAND > 0
+    battery_history_filter_init(&level_filter, CONFIG_ZMK_BATTERY_HISTORY_FILTER_DEADBAND,
+                                CONFIG_ZMK_BATTERY_HISTORY_FILTER_DWELL_MINUTES * 60 * 1000,
+                                IS_ENABLED(CONFIG_ZMK_BATTERY_HISTORY_FILTER_MONOTONIC));
+#endif
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_ADAPTIVE_INTERVAL
+    battery_history_interval_init(&recording_interval,
+                                  CONFIG_ZMK_BATTERY_HISTORY_MIN_INTERVAL_MINUTES * 60 * 1000,
+                                  CONFIG_ZMK_BATTERY_HISTORY_MAX_INTERVAL_MINUTES * 60 * 1000);
+#endif
 
-    // Start
-    k_work_schedule(&battery_history_work, K_NO_WAIT);
+    LOG_INF("Battery history backend: %s", battery_history_backend.name);
+    int rc = 0;
+    if (battery_history_backend.init != NULL) {
+        rc = battery_history_backend.init();
+    }
+    if (rc == 0) {
+        uint32_t start = k_cycle_get_32();
+        rc = battery_history_backend.load();
+        LOG_INF("Battery history backend load took %u us",
+                k_cyc_to_us_floor32(k_cycle_get_32() - start));
+    }
+    if (rc < 0 && rc != -EINPROGRESS) {
+        LOG_ERR("Failed to load battery history: %d", rc);
+    }
+    // Backends loaded through settings finish from their commit handler, and
+    // history stored in the per-entry layout is migrated before finishing
+    if (rc != -EINPROGRESS && !IS_ENABLED(CONFIG_ZMK_BATTERY_HISTORY_MIGRATE)) {
+        battery_history_restore_done();
+    }
+
+    // Start, unless settings are still loading
+    battery_history_start_recording();
 
     return 0;
 }
@@ -437,43 +990,102 @@ SYS_INIT(battery_history_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
 
 /* Public API implementation */
 
-int zmk_battery_history_get_count(void) { return history_count; }
+/**
+ * Index of the oldest ring entry within the whole history
+ * Entries before it are only available from the backend storage.
+ */
+static int get_ring_start(void) {
+    if (battery_history_backend.get_stored_count == NULL) {
+        return 0;
+    }
+    return battery_history_backend.get_stored_count() + MIN(unsaved_count, history_count) -
+           history_count;
+}
+
+int zmk_battery_history_get_count(void) {
+    if (unloaded_count > 0) {
+        // Called from the RPC thread, the ring is only changed by the work
+        // queue, so wait there for the load instead of returning part of the
+        // history
+        k_sem_reset(&load_done_sem);
+        k_work_submit(&battery_history_load_work);
+        if (k_sem_take(&load_done_sem, K_MSEC(LOAD_TIMEOUT_MS)) < 0) {
+            LOG_WRN("Battery history entries not loaded within %d ms", LOAD_TIMEOUT_MS);
+        }
+    }
+    return get_ring_start() + history_count - unloaded_count;
+}
 
 int zmk_battery_history_get_entry(int index, struct zmk_battery_history_entry *entry) {
-    if (index < 0 || index >= history_count || entry == NULL) {
+    // The oldest ring entries are skipped while they are not loaded
+    int skipped = unloaded_count;
+    int start = get_ring_start();
+
+    if (index < 0 || index >= start + history_count - skipped || entry == NULL) {
         return -EINVAL;
     }
-
-    int buffer_idx = get_buffer_index(index);
-    *entry = history_buffer[buffer_idx];
+    if (index < start) {
+        return battery_history_backend.read_stored(index, entry);
+    }
+    read_history_entry(index - start + skipped, entry);
     return 0;
 }
 
 int zmk_battery_history_get_current_level(void) { return current_battery_level; }
 
 int zmk_battery_history_clear(void) {
-    int cleared = history_count;
+    // Deferred entries are cleared too, there is no need to load them
+    unloaded_count = 0;
+    int cleared = get_ring_start() + history_count;
 
     history_head = 0;
     history_count = 0;
     unsaved_count = 0;
-    first_unsaved_idx = -1;
+    flush_pending = false;
+#ifndef CONFIG_ZMK_BATTERY_HISTORY_SESSIONS
     first_record_after_boot = true;
-    head_changed_since_save = false;
+#endif
     last_saved_battery_level = current_battery_level;
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_COMPACT_RAM
+    battery_history_compact_clear();
+#else
     memset(history_buffer, 0, sizeof(history_buffer));
+    ring_base = 0;
+#endif
 
-    // Save the cleared state using runtime_set + flush
-    settings_runtime_set("battery_history/head", &history_head, sizeof(history_head));
-    settings_runtime_set("battery_history/count", &history_count, sizeof(history_count));
-    settings_save();
+    // Save the cleared state
+    battery_history_backend.clear();
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_SLEEP_RECORD
+    battery_history_sleep_clear();
+#endif
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_ARCHIVE
+    battery_history_archive_clear();
+#endif
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_MILLIVOLTS
+    battery_history_millivolts_clear();
+#endif
 
     LOG_INF("Battery history cleared: %d entries removed", cleared);
     return cleared;
 }
 
-int zmk_battery_history_get_interval(void) { return CONFIG_ZMK_BATTERY_HISTORY_INTERVAL_MINUTES; }
+int zmk_battery_history_get_discarded_count(void) { return discarded_count; }
+
+int zmk_battery_history_get_interval(void) {
+    return MAX((recording_interval_ms + 30 * 1000) / (60 * 1000), 1);
+}
+
+int zmk_battery_history_get_max_entries(void) {
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_STORAGE_FILE
+    return CONFIG_ZMK_BATTERY_HISTORY_FILE_MAX_ENTRIES;
+#else
+    return MAX_ENTRIES;
+#endif
+}
 
-int zmk_battery_history_get_max_entries(void) { return MAX_ENTRIES; }
+int zmk_battery_history_save(void) { return save_history(false); }
 
-int zmk_battery_history_save(void) { return save_history(); }
+void zmk_battery_history_get_storage_stats(struct zmk_battery_history_storage_stats *stats) {
+    battery_history_stats_get(stats);
+    stats->wakeups = wakeup_count;
+}
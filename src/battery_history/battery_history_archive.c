@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - consolidated hourly/daily archives
+ *
+ * Entries dropped from the history ring are consolidated into round-robin
+ * tiers of min/avg/max rows, RRD style. Each tier accumulates its input until
+ * it covers the tier resolution, then emits a row that is also fed into the
+ * next coarser tier. The average is weighted by the time each input covers.
+ *
+ * Rows are stored in blocks under battery_history_archive/tNbM keys, and the
+ * ring positions and accumulators in battery_history_archive/s, which is
+ * written after the blocks it describes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include "battery_history_archive.h"
+#include "battery_history_stats.h"
+
+LOG_MODULE_DECLARE(zmk_battery_history, CONFIG_ZMK_LOG_LEVEL);
+
+#define NUM_TIERS 2
+#define BLOCK_ROWS 16
+#define MAX_BLOCKS DIV_ROUND_UP(MAX(CONFIG_ZMK_BATTERY_HISTORY_ARCHIVE_HOURLY_ROWS, \
+                                    CONFIG_ZMK_BATTERY_HISTORY_ARCHIVE_DAILY_ROWS),  \
+                                BLOCK_ROWS)
+
+BUILD_ASSERT(MAX_BLOCKS <= 32, "dirty blocks are tracked in a 32-bit mask");
+
+// Longest time between two periodic recordings
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_ADAPTIVE_INTERVAL
+#define MAX_CHECK_MINUTES CONFIG_ZMK_BATTERY_HISTORY_MAX_INTERVAL_MINUTES
+#else
+#define MAX_CHECK_MINUTES CONFIG_ZMK_BATTERY_HISTORY_INTERVAL_MINUTES
+#endif
+
+// Longer gaps between entries mean the device was asleep or rebooted, since a
+// stable level is still recorded by the first periodic recording 4 recording
+// intervals after the last entry while awake
+#define MAX_GAP_SEC ((CONFIG_ZMK_BATTERY_HISTORY_INTERVAL_MINUTES * 4 + MAX_CHECK_MINUTES) * 60)
+
+static struct zmk_battery_history_archive_row
+    hourly_rows[CONFIG_ZMK_BATTERY_HISTORY_ARCHIVE_HOURLY_ROWS];
+static struct zmk_battery_history_archive_row
+    daily_rows[CONFIG_ZMK_BATTERY_HISTORY_ARCHIVE_DAILY_ROWS];
+
+struct archive_tier {
+    uint16_t resolution_minutes;
+    uint16_t capacity;
+    struct zmk_battery_history_archive_row *rows;
+    uint32_t dirty_blocks;
+};
+
+static struct archive_tier tiers[NUM_TIERS] = {
+    {60, ARRAY_SIZE(hourly_rows), hourly_rows, 0},
+    {24 * 60, ARRAY_SIZE(daily_rows), daily_rows, 0},
+};
+
+/**
+ * Ring position and pending input of a tier
+ */
+struct tier_state {
+    uint16_t head;
+    uint16_t count;
+    uint32_t seconds;       // Time covered by the pending input
+    uint32_t level_seconds; // Sum of level * seconds of the pending input
+    uint8_t min_level;
+    uint8_t max_level;
+} __packed;
+
+struct archive_state {
+    uint16_t crc; // CRC16 of the rest of the record
+    uint32_t last_timestamp;
+    uint8_t has_last; // Whether last_timestamp holds the previous archived entry
+    struct tier_state tiers[NUM_TIERS];
+} __packed;
+
+struct block_record {
+    uint16_t crc; // CRC16 of the rows
+    struct zmk_battery_history_archive_row rows[BLOCK_ROWS];
+} __packed;
+
+static struct archive_state state;
+static bool state_dirty = false;
+
+static uint16_t get_record_crc(const void *record, size_t len) {
+    return crc16_ccitt(0xffff, (const uint8_t *)record + sizeof(uint16_t),
+                       len - sizeof(uint16_t));
+}
+
+static int get_block_length(const struct archive_tier *tier, int block) {
+    return MIN(BLOCK_ROWS, tier->capacity - block * BLOCK_ROWS);
+}
+
+static int get_num_blocks(const struct archive_tier *tier) {
+    return DIV_ROUND_UP(tier->capacity, BLOCK_ROWS);
+}
+
+static void push_row(int t, const struct zmk_battery_history_archive_row *row) {
+    struct archive_tier *tier = &tiers[t];
+    struct tier_state *ts = &state.tiers[t];
+    int idx;
+
+    if (ts->count < tier->capacity) {
+        idx = (ts->head + ts->count) % tier->capacity;
+        ts->count++;
+    } else {
+        idx = ts->head;
+        ts->head = (ts->head + 1) % tier->capacity;
+    }
+    tier->rows[idx] = *row;
+    tier->dirty_blocks |= BIT(idx / BLOCK_ROWS);
+}
+
+/**
+ * Add input covering a number of seconds to a tier, emitting a row once the
+ * tier resolution is covered
+ */
+static void accumulate(int t, uint8_t min_level, uint8_t avg_level, uint8_t max_level,
+                       uint32_t seconds) {
+    struct tier_state *ts = &state.tiers[t];
+
+    if (ts->seconds == 0) {
+        ts->min_level = min_level;
+        ts->max_level = max_level;
+    } else {
+        ts->min_level = MIN(ts->min_level, min_level);
+        ts->max_level = MAX(ts->max_level, max_level);
+    }
+    ts->seconds += seconds;
+    ts->level_seconds += avg_level * seconds;
+
+    if (ts->seconds < tiers[t].resolution_minutes * 60) {
+        return;
+    }
+
+    struct zmk_battery_history_archive_row row = {
+        .minutes = MIN(ts->seconds / 60, UINT16_MAX),
+        .min_level = ts->min_level,
+        .avg_level = (ts->level_seconds + ts->seconds / 2) / ts->seconds,
+        .max_level = ts->max_level,
+    };
+    ts->seconds = 0;
+    ts->level_seconds = 0;
+
+    push_row(t, &row);
+    if (t + 1 < NUM_TIERS) {
+        accumulate(t + 1, row.min_level, row.avg_level, row.max_level, row.minutes * 60);
+    }
+}
+
+void battery_history_archive_add(const struct zmk_battery_history_entry *entry) {
+    uint32_t seconds = 1;
+
+    if (state.has_last) {
+        uint32_t delta = entry->timestamp - state.last_timestamp;
+        seconds = CLAMP(delta, 1, MAX_GAP_SEC);
+    }
+    state.last_timestamp = entry->timestamp;
+    state.has_last = true;
+    state_dirty = true;
+
+    accumulate(0, entry->battery_level, entry->battery_level, entry->battery_level, seconds);
+}
+
+static int save_record(const char *key, const void *value, size_t len) {
+    int rc = settings_save_one(key, value, len);
+    if (rc < 0) {
+        LOG_ERR("Failed to save %s: %d", key, rc);
+        return rc;
+    }
+    battery_history_stats_add_write(1, len);
+    return 0;
+}
+
+static int save_block(int t, int block) {
+    const struct archive_tier *tier = &tiers[t];
+    struct block_record record;
+    size_t len = sizeof(record.crc) + get_block_length(tier, block) * sizeof(record.rows[0]);
+
+    memcpy(record.rows, &tier->rows[block * BLOCK_ROWS], len - sizeof(record.crc));
+    record.crc = get_record_crc(&record, len);
+
+    char key[40];
+    snprintf(key, sizeof(key), "battery_history_archive/t%db%d", t, block);
+    return save_record(key, &record, len);
+}
+
+int battery_history_archive_save(void) {
+    int written = 0;
+
+    if (!state_dirty) {
+        return 0;
+    }
+
+    for (int t = 0; t < NUM_TIERS; t++) {
+        struct archive_tier *tier = &tiers[t];
+
+        for (int block = 0; block < get_num_blocks(tier); block++) {
+            if (!(tier->dirty_blocks & BIT(block))) {
+                continue;
+            }
+            int rc = save_block(t, block);
+            if (rc < 0) {
+                return rc;
+            }
+            tier->dirty_blocks &= ~BIT(block);
+            written++;
+        }
+    }
+
+    // Commit the ring positions only once the rows they describe are stored
+    state.crc = get_record_crc(&state, sizeof(state));
+    int rc = save_record("battery_history_archive/s", &state, sizeof(state));
+    if (rc < 0) {
+        return rc;
+    }
+    state_dirty = false;
+    return written + 1;
+}
+
+void battery_history_archive_clear(void) {
+    memset(&state, 0, sizeof(state));
+    state_dirty = false;
+    settings_delete("battery_history_archive/s");
+
+    for (int t = 0; t < NUM_TIERS; t++) {
+        struct archive_tier *tier = &tiers[t];
+
+        tier->dirty_blocks = 0;
+        memset(tier->rows, 0, tier->capacity * sizeof(tier->rows[0]));
+        for (int block = 0; block < get_num_blocks(tier); block++) {
+            char key[40];
+            snprintf(key, sizeof(key), "battery_history_archive/t%db%d", t, block);
+            settings_delete(key);
+        }
+    }
+}
+
+static int load_state(size_t len, settings_read_cb read_cb, void *cb_arg) {
+    struct archive_state loaded;
+
+    if (len != sizeof(loaded)) {
+        return -EINVAL;
+    }
+    int rc = read_cb(cb_arg, &loaded, sizeof(loaded));
+    if (rc < 0) {
+        return rc;
+    }
+
+    bool valid = loaded.crc == get_record_crc(&loaded, sizeof(loaded));
+    for (int t = 0; valid && t < NUM_TIERS; t++) {
+        valid = loaded.tiers[t].head < tiers[t].capacity &&
+                loaded.tiers[t].count <= tiers[t].capacity;
+    }
+    if (!valid) {
+        // Start a new archive rather than trusting positions we cannot check
+        LOG_WRN("Discarding corrupt battery history archive state");
+        return 0;
+    }
+    state = loaded;
+    return 0;
+}
+
+static int load_block(int t, int block, size_t len, settings_read_cb read_cb, void *cb_arg) {
+    struct archive_tier *tier = &tiers[t];
+    struct block_record record;
+    size_t expected = sizeof(record.crc) + get_block_length(tier, block) * sizeof(record.rows[0]);
+
+    if (len != expected) {
+        return -EINVAL;
+    }
+    int rc = read_cb(cb_arg, &record, len);
+    if (rc < 0) {
+        return rc;
+    }
+    if (record.crc != get_record_crc(&record, len)) {
+        // Rows left empty cover no time and are skipped by readers
+        LOG_WRN("Discarding corrupt battery history archive block t%db%d", t, block);
+        return 0;
+    }
+    memcpy(&tier->rows[block * BLOCK_ROWS], record.rows, len - sizeof(record.crc));
+    return 0;
+}
+
+static int archive_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+                                void *cb_arg) {
+    if (!strcmp(name, "s")) {
+        return load_state(len, read_cb, cb_arg);
+    }
+
+    if (name[0] == 't') {
+        char *end;
+        int t = strtol(name + 1, &end, 10);
+        if (*end == 'b' && t >= 0 && t < NUM_TIERS) {
+            int block = atoi(end + 1);
+            if (block >= 0 && block < get_num_blocks(&tiers[t])) {
+                return load_block(t, block, len, read_cb, cb_arg);
+            }
+        }
+    }
+
+    return -ENOENT;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(battery_history_archive, "battery_history_archive", NULL,
+                               archive_settings_set, NULL, NULL);
+
+/* Public API implementation */
+
+int zmk_battery_history_get_archive_tier_count(void) { return NUM_TIERS; }
+
+int zmk_battery_history_get_archive_resolution(int tier) {
+    if (tier < 0 || tier >= NUM_TIERS) {
+        return -EINVAL;
+    }
+    return tiers[tier].resolution_minutes;
+}
+
+int zmk_battery_history_get_archive_row_count(int tier) {
+    if (tier < 0 || tier >= NUM_TIERS) {
+        return -EINVAL;
+    }
+    return state.tiers[tier].count;
+}
+
+int zmk_battery_history_get_archive_row(int tier, int index,
+                                        struct zmk_battery_history_archive_row *row) {
+    if (tier < 0 || tier >= NUM_TIERS || index < 0 || index >= state.tiers[tier].count ||
+        row == NULL) {
+        return -EINVAL;
+    }
+    *row = tiers[tier].rows[(state.tiers[tier].head + index) % tiers[tier].capacity];
+    return 0;
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - consolidated hourly/daily archives
+ */
+
+#pragma once
+
+#include <zmk/battery_history/battery_history.h>
+
+/**
+ * @brief Consolidate an entry that was dropped from the history ring
+ * @param entry Entry in recording order, oldest first
+ */
+void battery_history_archive_add(const struct zmk_battery_history_entry *entry);
+
+/**
+ * @brief Write the archive records changed since the last save
+ * @return Number of settings records written, or negative error code
+ */
+int battery_history_archive_save(void);
+
+/**
+ * @brief Drop every archived row and delete the stored archive
+ */
+void battery_history_archive_clear(void);
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - storage backend interface
+ *
+ * The core keeps the RAM ring and the recording policy, a backend persists
+ * the ring. Exactly one backend is linked in, chosen by the
+ * ZMK_BATTERY_HISTORY_STORAGE_LAYOUT Kconfig choice, and it defines the
+ * battery_history_backend instance below.
+ */
+
+#pragma once
+
+#include <zmk/battery_history/battery_history.h>
+
+// Capacity of the RAM ring
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_FLASH_ONLY
+#define BATTERY_HISTORY_RING_ENTRIES CONFIG_ZMK_BATTERY_HISTORY_STAGING_ENTRIES
+#else
+#define BATTERY_HISTORY_RING_ENTRIES CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES
+#endif
+
+/**
+ * Write counters of a backend since boot
+ */
+struct battery_history_backend_stats {
+    uint32_t records_written;
+    uint32_t bytes_written;
+};
+
+struct battery_history_backend {
+    const char *name;
+
+    /**
+     * @brief Prepare the storage, e.g. mount a partition (optional)
+     * @return 0 on success, negative error code on failure
+     */
+    int (*init)(void);
+
+    /**
+     * @brief Restore the stored entries into the ring
+     * Entries are handed over with the battery_history_restore_*() functions.
+     * @return 0 once restored, -EINPROGRESS if battery_history_restore_done()
+     *         is called later (e.g. by a settings commit handler), or negative
+     *         error code
+     */
+    int (*load)(void);
+
+    /**
+     * @brief Restore entries that load() left in storage (optional)
+     * load() only sets the ring position and restores the newest entry then,
+     * and this is called once the other entries are first needed. Slots
+     * outside the requested range already hold newer entries and are left
+     * alone by battery_history_restore_slot().
+     * @param count Number of oldest ring entries to restore
+     * @return Number of oldest entries that could not be restored and are
+     *         dropped from the ring, or negative error code
+     */
+    int (*load_entries)(int count);
+
+    /**
+     * @brief Store entries newly added to the ring
+     * Called with the unsaved entries in order, possibly in several batches.
+     * @param index Ring index of the first entry (0 = oldest in the ring)
+     * @param entries Entries to store, oldest first
+     * @param count Number of entries
+     * @return Number of records written, or negative error code
+     */
+    int (*append)(int index, const struct zmk_battery_history_entry *entries, int count);
+
+    /**
+     * @brief Commit the appended entries, e.g. write a header (optional)
+     * @return Number of records written, or negative error code
+     */
+    int (*flush)(void);
+
+    /**
+     * @brief Remove every stored entry
+     * @return 0 on success, negative error code on failure
+     */
+    int (*clear)(void);
+
+    /**
+     * @brief Get the backend counters
+     */
+    void (*get_stats)(struct battery_history_backend_stats *stats);
+
+    /**
+     * @brief Get the number of stored entries, if the backend keeps more
+     * entries than the ring (optional)
+     */
+    int (*get_stored_count)(void);
+
+    /**
+     * @brief Read a stored entry (0 = oldest stored), required with
+     * get_stored_count
+     * @return 0 on success, -EBADMSG if the entry is corrupt, or negative
+     *         error code
+     */
+    int (*read_stored)(int index, struct zmk_battery_history_entry *entry);
+};
+
+extern const struct battery_history_backend battery_history_backend;
+
+/* Ring access for backends, implemented by the core */
+
+/**
+ * @brief Get the number of entries in the ring
+ */
+int battery_history_ring_count(void);
+
+/**
+ * @brief Append a restored entry to the ring, oldest first
+ */
+void battery_history_restore_entry(const struct zmk_battery_history_entry *entry);
+
+/**
+ * @brief Append an entry migrated from another layout as the newest unsaved
+ * entry, before battery_history_restore_done()
+ * Written to the active backend whenever the ring would otherwise drop it.
+ */
+void battery_history_import_entry(const struct zmk_battery_history_entry *entry);
+
+/**
+ * @brief Append an entry as the newest unsaved entry, after
+ * battery_history_restore_done(), like a newly recorded one
+ */
+void battery_history_add_entry(const struct zmk_battery_history_entry *entry);
+
+/**
+ * @brief Save the unsaved entries right away, overdrawing the save budget if
+ * needed, e.g. before deleting their only other copy
+ * @return Number of records written, or negative error code
+ */
+int battery_history_save_now(void);
+
+/**
+ * @brief Hand every ring entry to the backend again, e.g. to store them in a
+ * newer record format
+ * @return Number of records written, or negative error code
+ */
+int battery_history_rewrite(void);
+
+#ifndef CONFIG_ZMK_BATTERY_HISTORY_COMPACT_RAM
+/**
+ * @brief Get the buffer index of the oldest ring entry
+ * Slot-addressed backends store entry N of the ring at slot (head + N) %
+ * ZMK_BATTERY_HISTORY_MAX_ENTRIES.
+ */
+int battery_history_ring_head(void);
+
+/**
+ * @brief Read the entry at a buffer slot
+ */
+void battery_history_ring_read_slot(int slot, struct zmk_battery_history_entry *entry);
+
+/**
+ * @brief Place a restored entry at a buffer slot
+ */
+void battery_history_restore_slot(int slot, const struct zmk_battery_history_entry *entry);
+
+/**
+ * @brief Set the ring position once all slots are restored
+ */
+void battery_history_restore_ring(int head, int count);
+#endif
+
+/**
+ * @brief Count a corrupt record discarded while loading
+ */
+void battery_history_count_discarded(void);
+
+/**
+ * @brief Finish loading after load() returned -EINPROGRESS
+ */
+void battery_history_restore_done(void);
+
+/**
+ * @brief Start periodic recording once everything it waits for is loaded,
+ * called by each module that holds it back, no polling is needed
+ */
+void battery_history_start_recording(void);
@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - settings backend with blocks of entries
+ *
+ * The ring is stored in blocks of ZMK_BATTERY_HISTORY_BLOCK_ENTRIES slots
+ * under battery_history/bN keys. Every block record is self-describing: it
+ * carries the sequence number of the newest entry it holds, so the ring is
+ * rebuilt from the blocks alone. Entry N since the last clear always lives at
+ * buffer slot N % ZMK_BATTERY_HISTORY_MAX_ENTRIES.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include "battery_history_backend.h"
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_COMPRESSION
+#include "battery_history_codec.h"
+#endif
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_MIGRATE
+#include "battery_history_migrate.h"
+#endif
+
+LOG_MODULE_DECLARE(zmk_battery_history, CONFIG_ZMK_LOG_LEVEL);
+
+#define MAX_ENTRIES CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES
+#define BLOCK_ENTRIES CONFIG_ZMK_BATTERY_HISTORY_BLOCK_ENTRIES
+#define NUM_BLOCKS DIV_ROUND_UP(MAX_ENTRIES, BLOCK_ENTRIES)
+
+// Blocks containing entries that have not been written to settings yet
+static ATOMIC_DEFINE(dirty_blocks, NUM_BLOCKS);
+// Block holding the oldest unsaved entry, written first (-1 = none)
+static int first_dirty_block = -1;
+// Entries appended since the last flush
+static int pending_count = 0;
+
+struct block_header {
+    uint16_t crc; // CRC16 of the rest of the record
+    uint32_t seq; // Sequence number of the newest entry in the block
+    uint8_t slot; // Offset of that entry within the block
+} __packed;
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_COMPRESSION
+#define BLOCK_PAYLOAD_SIZE BATTERY_HISTORY_CODEC_MAX_SIZE(BLOCK_ENTRIES)
+#else
+#define BLOCK_PAYLOAD_SIZE (BLOCK_ENTRIES * sizeof(struct zmk_battery_history_entry))
+#endif
+
+struct block_record {
+    struct block_header header;
+    uint8_t payload[BLOCK_PAYLOAD_SIZE]; // Raw or compressed entries
+} __packed;
+
+// Sequence number of the next entry to be added
+static uint32_t next_seq = 0;
+
+// Headers of the blocks read while loading settings
+static struct block_header loaded_block_headers[NUM_BLOCKS];
+static ATOMIC_DEFINE(loaded_blocks, NUM_BLOCKS);
+
+static struct battery_history_backend_stats stats;
+
+/**
+ * CRC16 of a storage record, skipping its leading CRC field
+ */
+static uint16_t get_record_crc(const void *record, size_t len) {
+    return crc16_ccitt(0xffff, (const uint8_t *)record + sizeof(uint16_t),
+                       len - sizeof(uint16_t));
+}
+
+/**
+ * Number of entries covered by a block (the last block may be shorter)
+ */
+static int get_block_length(int block) {
+    return MIN(BLOCK_ENTRIES, MAX_ENTRIES - block * BLOCK_ENTRIES);
+}
+
+/**
+ * Save a whole block of entries together with its sequence header
+ */
+static int save_single_block(int block) {
+    struct zmk_battery_history_entry entries[BLOCK_ENTRIES];
+    struct block_record record;
+    int first = block * BLOCK_ENTRIES;
+    int length = get_block_length(block);
+    uint32_t newest_seq = next_seq - 1;
+    int newest_idx = newest_seq % MAX_ENTRIES;
+
+    // The newest entry of the block is the newest entry overall if the block
+    // holds it, otherwise the block is completely filled by the current lap
+    int slot = (newest_idx >= first && newest_idx < first + length) ? newest_idx - first
+                                                                    : length - 1;
+    record.header.slot = slot;
+    record.header.seq =
+        newest_seq - (newest_idx - (first + slot) + MAX_ENTRIES) % MAX_ENTRIES;
+
+    for (int i = 0; i < length; i++) {
+        battery_history_ring_read_slot(first + i, &entries[i]);
+    }
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_COMPRESSION
+    int payload_len =
+        battery_history_codec_encode(entries, length, record.payload, sizeof(record.payload));
+    if (payload_len < 0) {
+        LOG_ERR("Failed to encode block %d: %d", block, payload_len);
+        return payload_len;
+    }
+#else
+    int payload_len = length * sizeof(struct zmk_battery_history_entry);
+    memcpy(record.payload, entries, payload_len);
+#endif
+
+    size_t len = sizeof(struct block_header) + payload_len;
+    record.header.crc = get_record_crc(&record, len);
+
+    char key[32];
+    snprintf(key, sizeof(key), "battery_history/b%d", block);
+
+    int rc = settings_save_one(key, &record, len);
+    if (rc < 0) {
+        LOG_ERR("Failed to save %s: %d", key, rc);
+        return rc;
+    }
+    stats.records_written++;
+    stats.bytes_written += len;
+    return 0;
+}
+
+static int blocks_backend_load(void) {
+    // Loaded by the settings subsystem, see the commit handler
+    return -EINPROGRESS;
+}
+
+static int blocks_backend_append(int index, const struct zmk_battery_history_entry *entries,
+                                 int count) {
+    int head = battery_history_ring_head();
+
+    // The entries are already in the ring, whole blocks are written on flush
+    for (int i = 0; i < count; i++) {
+        int block = (head + index + i) % MAX_ENTRIES / BLOCK_ENTRIES;
+        if (first_dirty_block < 0) {
+            first_dirty_block = block;
+        }
+        atomic_set_bit(dirty_blocks, block);
+    }
+    pending_count += count;
+    return 0;
+}
+
+/**
+ * Save every dirty block, keeping blocks that failed marked dirty
+ * Blocks are written oldest first, so an interrupted save still leaves a
+ * contiguous history behind.
+ */
+static int blocks_backend_flush(void) {
+    int written = 0;
+
+    if (first_dirty_block < 0) {
+        return 0;
+    }
+
+    if (pending_count > 0) {
+        if (pending_count < MAX_ENTRIES) {
+            next_seq += pending_count;
+        } else {
+            // Entries dropped from the ring before they were saved took
+            // sequence numbers too. Skip at least a full lap, so no rewritten
+            // block can be mistaken for one of the previous lap.
+            int end = (battery_history_ring_head() + battery_history_ring_count()) % MAX_ENTRIES;
+            next_seq += MAX_ENTRIES + (end - (int)(next_seq % MAX_ENTRIES) + MAX_ENTRIES) %
+                                          MAX_ENTRIES;
+        }
+        pending_count = 0;
+    }
+
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        int block = (first_dirty_block + i) % NUM_BLOCKS;
+        if (!atomic_test_and_clear_bit(dirty_blocks, block)) {
+            continue;
+        }
+        LOG_DBG("Block save: block %d", block);
+        int rc = save_single_block(block);
+        if (rc < 0) {
+            atomic_set_bit(dirty_blocks, block);
+            first_dirty_block = block;
+            return rc;
+        }
+        written++;
+    }
+    first_dirty_block = -1;
+    return written;
+}
+
+static int blocks_backend_clear(void) {
+    // Blocks describe themselves, so they have to be removed
+    next_seq = 0;
+    first_dirty_block = -1;
+    pending_count = 0;
+    for (int block = 0; block < NUM_BLOCKS; block++) {
+        char key[32];
+        snprintf(key, sizeof(key), "battery_history/b%d", block);
+        atomic_clear_bit(dirty_blocks, block);
+        settings_delete(key);
+    }
+    return 0;
+}
+
+static void blocks_backend_get_stats(struct battery_history_backend_stats *out) { *out = stats; }
+
+const struct battery_history_backend battery_history_backend = {
+    .name = "blocks",
+    .load = blocks_backend_load,
+    .append = blocks_backend_append,
+    .flush = blocks_backend_flush,
+    .clear = blocks_backend_clear,
+    .get_stats = blocks_backend_get_stats,
+};
+
+/**
+ * Load a block record into the ring and remember its sequence header
+ */
+static int load_block(int block, size_t len, settings_read_cb read_cb, void *cb_arg) {
+    struct zmk_battery_history_entry entries[BLOCK_ENTRIES];
+    struct block_record record;
+    int length = get_block_length(block);
+
+    if (len <= sizeof(struct block_header) || len > sizeof(record)) {
+        return -EINVAL;
+    }
+    int rc = read_cb(cb_arg, &record, len);
+    if (rc < 0) {
+        return rc;
+    }
+
+    size_t payload_len = len - sizeof(struct block_header);
+    bool valid = record.header.crc == get_record_crc(&record, len) && record.header.slot < length;
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_COMPRESSION
+    valid = valid &&
+            battery_history_codec_decode(record.payload, payload_len, entries, length) == length;
+#else
+    valid = valid && payload_len == length * sizeof(struct zmk_battery_history_entry);
+    if (valid) {
+        memcpy(entries, record.payload, payload_len);
+    }
+#endif
+    if (!valid) {
+        // Leave the block out, the rebuild treats it as a gap
+        LOG_WRN("Discarding corrupt battery history block %d", block);
+        battery_history_count_discarded();
+        return 0;
+    }
+
+    for (int i = 0; i < length; i++) {
+        battery_history_restore_slot(block * BLOCK_ENTRIES + i, &entries[i]);
+    }
+    loaded_block_headers[block] = record.header;
+    atomic_set_bit(loaded_blocks, block);
+    return 0;
+}
+
+/**
+ * Sequence number of the entry stored at an offset of a loaded block
+ * Offsets after the newest entry still hold entries of the previous lap.
+ */
+static int64_t get_stored_seq(int block, int offset) {
+    const struct block_header *header = &loaded_block_headers[block];
+    int64_t seq = (int64_t)header->seq - header->slot + offset;
+
+    return offset > header->slot ? seq - MAX_ENTRIES : seq;
+}
+
+/**
+ * Rebuild head and count from the loaded blocks in a single pass
+ * Walks back from the newest entry as long as every buffer slot holds the
+ * expected sequence number, so blocks missing from an interrupted save only
+ * cut off the history older than them.
+ */
+static void rebuild_from_blocks(void) {
+    bool found = false;
+    uint32_t newest_seq = 0;
+
+    for (int block = 0; block < NUM_BLOCKS; block++) {
+        if (atomic_test_bit(loaded_blocks, block) &&
+            (!found || loaded_block_headers[block].seq > newest_seq)) {
+            newest_seq = loaded_block_headers[block].seq;
+            found = true;
+        }
+    }
+    if (!found) {
+        return;
+    }
+
+    int count = 0;
+    while (count < MAX_ENTRIES && count <= newest_seq) {
+        uint32_t seq = newest_seq - count;
+        int idx = seq % MAX_ENTRIES;
+        int block = idx / BLOCK_ENTRIES;
+
+        if (!atomic_test_bit(loaded_blocks, block) ||
+            get_stored_seq(block, idx % BLOCK_ENTRIES) != seq) {
+            LOG_WRN("Battery history has a gap before sequence %u", seq);
+            break;
+        }
+        count++;
+    }
+
+    next_seq = newest_seq + 1;
+    battery_history_restore_ring((next_seq - count) % MAX_ENTRIES, count);
+}
+
+/**
+ * Settings load handler
+ */
+static int blocks_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+                               void *cb_arg) {
+    // self-describing blocks of entries with "bN" keys
+    if (name[0] == 'b') {
+        int block = atoi(name + 1);
+        if (block >= 0 && block < NUM_BLOCKS) {
+            return load_block(block, len, read_cb, cb_arg);
+        }
+    }
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_MIGRATE
+    return battery_history_migrate_set(name, len, read_cb, cb_arg);
+#else
+    return -ENOENT;
+#endif
+}
+
+/**
+ * Settings commit handler - called after all settings are loaded
+ */
+static int blocks_settings_commit(void) {
+    rebuild_from_blocks();
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_MIGRATE
+    battery_history_migrate_commit();
+#else
+    battery_history_restore_done();
+#endif
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(battery_history, "battery_history", NULL, blocks_settings_set,
+                               blocks_settings_commit, NULL);
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - flash save budget
+ */
+
+#include "battery_history_budget.h"
+
+#define MS_PER_DAY (24LL * 60 * 60 * 1000)
+
+void battery_history_budget_init(struct battery_history_budget *budget, int saves_per_day,
+                                 int burst, int64_t now_ms) {
+    budget->token_ms = MS_PER_DAY / saves_per_day;
+    budget->burst_ms = budget->token_ms * burst;
+    // Boots do not start with a full bucket, so reboot loops stay bounded too
+    budget->banked_ms = budget->token_ms;
+    budget->updated_ms = now_ms;
+}
+
+int64_t battery_history_budget_take(struct battery_history_budget *budget, int64_t now_ms,
+                                    bool urgent) {
+    budget->banked_ms += now_ms - budget->updated_ms;
+    if (budget->banked_ms > budget->burst_ms) {
+        budget->banked_ms = budget->burst_ms;
+    }
+    budget->updated_ms = now_ms;
+
+    int64_t floor_ms = urgent ? -budget->burst_ms : 0;
+    int64_t missing_ms = floor_ms + budget->token_ms - budget->banked_ms;
+    if (missing_ms > 0) {
+        return missing_ms;
+    }
+    budget->banked_ms -= budget->token_ms;
+    return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - flash save budget
+ *
+ * A token bucket refilled at a fixed number of saves per day. The bucket is
+ * kept as banked refill time in milliseconds: every save costs the refill
+ * time of one token, and at most a burst of tokens can be banked. Urgent
+ * saves, whose entries would be lost otherwise, may overdraw the bucket by
+ * one full burst. So at most 1 + burst + days * saves_per_day saves happen
+ * over any uptime, whatever triggers them.
+ *
+ * This file has no Zephyr dependencies so it can be tested on the host.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct battery_history_budget {
+    int64_t banked_ms;  // Refill time banked, negative when overdrawn
+    int64_t updated_ms; // Uptime of the last refill
+    int64_t token_ms;   // Refill time of a single save
+    int64_t burst_ms;   // Refill time of a full bucket
+};
+
+/**
+ * @brief Set up a budget holding a single token
+ * @param saves_per_day Refill rate
+ * @param burst Number of saves that can be banked
+ * @param now_ms Current uptime
+ */
+void battery_history_budget_init(struct battery_history_budget *budget, int saves_per_day,
+                                 int burst, int64_t now_ms);
+
+/**
+ * @brief Take a save from the budget
+ * @param now_ms Current uptime, never decreasing
+ * @param urgent Allow overdrawing the bucket by one full burst
+ * @return 0 if the save may go ahead, otherwise the time in ms until it may
+ */
+int64_t battery_history_budget_take(struct battery_history_budget *budget, int64_t now_ms,
+                                    bool urgent);
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - compressed entry encoding
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "battery_history_codec.h"
+
+struct bit_writer {
+    uint8_t *buf;
+    size_t bit;
+};
+
+struct bit_reader {
+    const uint8_t *buf;
+    size_t bit;
+};
+
+static void write_bits(struct bit_writer *w, uint32_t value, int bits) {
+    for (int i = 0; i < bits; i++, w->bit++) {
+        if (value & (1U << i)) {
+            w->buf[w->bit / 8] |= 1U << (w->bit % 8);
+        }
+    }
+}
+
+static uint32_t read_bits(struct bit_reader *r, int bits) {
+    uint32_t value = 0;
+    for (int i = 0; i < bits; i++, r->bit++) {
+        if (r->buf[r->bit / 8] & (1U << (r->bit % 8))) {
+            value |= 1U << i;
+        }
+    }
+    return value;
+}
+
+static int bit_width(uint32_t value) {
+    int bits = 0;
+    while (value) {
+        bits++;
+        value >>= 1;
+    }
+    return bits;
+}
+
+static uint32_t time_delta(const struct zmk_battery_history_entry *entries, int i) {
+    // Taken modulo 2^32, so runs that are not increasing still round-trip
+    return entries[i].timestamp - entries[i - 1].timestamp;
+}
+
+static uint8_t level_delta(const struct zmk_battery_history_entry *entries, int i) {
+    int delta = (int)entries[i].battery_level - (int)entries[i - 1].battery_level;
+    // Zigzag: small positive and negative deltas map to small codes
+    return (uint8_t)(delta >= 0 ? delta * 2 : -delta * 2 - 1);
+}
+
+int battery_history_codec_encode(const struct zmk_battery_history_entry *entries, int count,
+                                 uint8_t *buf, size_t size) {
+    int time_bits = 0;
+    int level_bits = 0;
+
+    if (count < 1 || count > BATTERY_HISTORY_CODEC_MAX_ENTRIES) {
+        return -EINVAL;
+    }
+    for (int i = 0; i < count; i++) {
+        // Zigzag codes of larger deltas would not fit in a byte
+        if (entries[i].battery_level > 127) {
+            return -EINVAL;
+        }
+        if (i > 0) {
+            int t = bit_width(time_delta(entries, i));
+            int l = bit_width(level_delta(entries, i));
+            time_bits = t > time_bits ? t : time_bits;
+            level_bits = l > level_bits ? l : level_bits;
+        }
+    }
+
+    size_t len =
+        BATTERY_HISTORY_CODEC_HEADER_SIZE + ((count - 1) * (time_bits + level_bits) + 7) / 8;
+    if (len > size) {
+        return -ENOMEM;
+    }
+
+    memset(buf, 0, len);
+    buf[0] = (uint8_t)count;
+    for (int i = 0; i < 4; i++) {
+        buf[1 + i] = (uint8_t)(entries[0].timestamp >> (8 * i));
+    }
+    buf[5] = entries[0].battery_level;
+    buf[6] = (uint8_t)time_bits;
+    buf[7] = (uint8_t)level_bits;
+
+    struct bit_writer w = {.buf = buf + BATTERY_HISTORY_CODEC_HEADER_SIZE};
+    for (int i = 1; i < count; i++) {
+        write_bits(&w, time_delta(entries, i), time_bits);
+        write_bits(&w, level_delta(entries, i), level_bits);
+    }
+    return (int)len;
+}
+
+int battery_history_codec_decode(const uint8_t *buf, size_t len,
+                                 struct zmk_battery_history_entry *entries, int max_count) {
+    if (len < BATTERY_HISTORY_CODEC_HEADER_SIZE) {
+        return -EINVAL;
+    }
+
+    int count = buf[0];
+    int time_bits = buf[6];
+    int level_bits = buf[7];
+    if (count < 1 || count > max_count || time_bits > 32 || level_bits > 8 ||
+        len != (size_t)(BATTERY_HISTORY_CODEC_HEADER_SIZE +
+                        ((count - 1) * (time_bits + level_bits) + 7) / 8)) {
+        return -EINVAL;
+    }
+
+    entries[0].timestamp = 0;
+    for (int i = 0; i < 4; i++) {
+        entries[0].timestamp |= (uint32_t)buf[1 + i] << (8 * i);
+    }
+    entries[0].battery_level = buf[5];
+
+    struct bit_reader r = {.buf = buf + BATTERY_HISTORY_CODEC_HEADER_SIZE};
+    for (int i = 1; i < count; i++) {
+        uint32_t dt = read_bits(&r, time_bits);
+        uint8_t zz = read_bits(&r, level_bits);
+        int dl = (zz & 1) ? -(int)((zz + 1) / 2) : (int)(zz / 2);
+        int level = (int)entries[i - 1].battery_level + dl;
+        if (level < 0 || level > 255) {
+            return -EINVAL;
+        }
+        entries[i].timestamp = entries[i - 1].timestamp + dt;
+        entries[i].battery_level = (uint8_t)level;
+    }
+    return count;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - compressed entry encoding
+ *
+ * A run of entries is stored as the first entry verbatim followed by the
+ * timestamp delta and zigzag-encoded level delta of every further entry,
+ * bit-packed with the narrowest field widths that fit the whole run:
+ *
+ *   u8 count | u32 first timestamp | u8 first level | u8 time bits |
+ *   u8 level bits | (count - 1) x (time delta, level delta) bitstream
+ *
+ * This file has no Zephyr dependencies so it can be tested on the host.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zmk/battery_history/battery_history.h>
+
+#define BATTERY_HISTORY_CODEC_HEADER_SIZE 8
+
+// Maximum number of entries in a single encoded run
+#define BATTERY_HISTORY_CODEC_MAX_ENTRIES 255
+
+/**
+ * @brief Worst-case encoded size of a run of entries
+ */
+#define BATTERY_HISTORY_CODEC_MAX_SIZE(count)                                                      \
+    (BATTERY_HISTORY_CODEC_HEADER_SIZE + (((count) - 1) * (32 + 8) + 7) / 8)
+
+/**
+ * @brief Encode a run of entries
+ * @param entries Entries to encode, oldest first
+ * @param count Number of entries (1 to BATTERY_HISTORY_CODEC_MAX_ENTRIES)
+ * @param buf Output buffer
+ * @param size Size of the output buffer
+ * @return Number of bytes written, or negative error code
+ */
+int battery_history_codec_encode(const struct zmk_battery_history_entry *entries, int count,
+                                 uint8_t *buf, size_t size);
+
+/**
+ * @brief Decode a run of entries
+ * @param buf Encoded data
+ * @param len Length of the encoded data
+ * @param entries Output entries
+ * @param max_count Capacity of the output array
+ * @return Number of entries decoded, or negative error code
+ */
+int battery_history_codec_decode(const uint8_t *buf, size_t len,
+                                 struct zmk_battery_history_entry *entries, int max_count);
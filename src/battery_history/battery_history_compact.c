@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - compact 2-byte in-RAM entry ring
+ *
+ * Entries are kept as 16-bit words holding a 7-bit level and a 9-bit time
+ * delta to the previous entry, counted in 1/16 of the recording interval.
+ * Gaps that do not fit (long sleeps, reboots) are stored as an escape entry: a
+ * word with the level field set to ESCAPE_LEVEL and the real level below it,
+ * followed by the low and high half of the absolute timestamp.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <zephyr/sys/util.h>
+
+#include "battery_history_compact.h"
+
+// Ring capacity in words, an escape entry takes three of them
+#define CAPACITY CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES
+
+#define LEVEL_SHIFT 9
+#define DELTA_MASK BIT_MASK(LEVEL_SHIFT)
+#define ESCAPE_LEVEL 0x7f
+#define ESCAPE_WORDS 3
+
+// Resolution of the stored time deltas in seconds
+#define TIME_UNIT_SEC MAX(1, CONFIG_ZMK_BATTERY_HISTORY_INTERVAL_MINUTES * 60 / 16)
+
+BUILD_ASSERT(CAPACITY >= ESCAPE_WORDS, "an escape entry needs three words");
+
+static uint16_t words[CAPACITY];
+static int head = 0;  // Word index of the oldest entry
+static int used = 0;  // Number of words in use
+static int count = 0; // Number of entries
+
+// Timestamp of the oldest entry, its own delta refers to an evicted entry
+static uint32_t oldest_timestamp = 0;
+// Newest entry, needed for every push
+static struct zmk_battery_history_entry newest;
+
+// Position of the last entry read, so iterating over the ring stays linear
+static struct {
+    bool valid;
+    int index;
+    int word;
+    uint32_t timestamp;
+} cursor;
+
+static bool is_escape(uint16_t word) { return (word >> LEVEL_SHIFT) == ESCAPE_LEVEL; }
+
+static int next_word(int word) { return (word + 1) % CAPACITY; }
+
+static void write_word(uint16_t value) {
+    words[(head + used) % CAPACITY] = value;
+    used++;
+}
+
+/**
+ * Timestamp of the entry at a word given the timestamp of the entry before it
+ */
+static uint32_t get_timestamp(int word, uint32_t prev_timestamp) {
+    if (is_escape(words[word])) {
+        int low = next_word(word);
+        return words[low] | (uint32_t)words[next_word(low)] << 16;
+    }
+    return prev_timestamp + (words[word] & DELTA_MASK) * TIME_UNIT_SEC;
+}
+
+static uint8_t get_level(int word) {
+    return is_escape(words[word]) ? words[word] & DELTA_MASK : words[word] >> LEVEL_SHIFT;
+}
+
+static void drop_oldest(void) {
+    int n = is_escape(words[head]) ? ESCAPE_WORDS : 1;
+
+    head = (head + n) % CAPACITY;
+    used -= n;
+    count--;
+    if (count > 0) {
+        oldest_timestamp = get_timestamp(head, oldest_timestamp);
+    }
+
+    if (cursor.valid && cursor.index > 0) {
+        cursor.index--;
+    } else {
+        cursor.valid = false;
+    }
+}
+
+void battery_history_compact_push(const struct zmk_battery_history_entry *entry) {
+    // A timestamp going backwards shows up as a huge delta
+    uint32_t delta = entry->timestamp - newest.timestamp;
+    uint64_t units = ((uint64_t)delta + TIME_UNIT_SEC / 2) / TIME_UNIT_SEC;
+    bool escape = count == 0 || units > DELTA_MASK || entry->battery_level >= ESCAPE_LEVEL;
+    int needed = escape ? ESCAPE_WORDS : 1;
+
+    while (CAPACITY - used < needed) {
+        drop_oldest();
+    }
+
+    if (escape) {
+        write_word((ESCAPE_LEVEL << LEVEL_SHIFT) | (entry->battery_level & DELTA_MASK));
+        write_word(entry->timestamp & 0xffff);
+        write_word(entry->timestamp >> 16);
+        newest.timestamp = entry->timestamp;
+    } else {
+        write_word((entry->battery_level << LEVEL_SHIFT) | (uint16_t)units);
+        newest.timestamp += units * TIME_UNIT_SEC;
+    }
+    newest.battery_level = entry->battery_level;
+
+    if (count == 0) {
+        oldest_timestamp = newest.timestamp;
+    }
+    count++;
+}
+
+int battery_history_compact_count(void) { return count; }
+
+int battery_history_compact_get(int index, struct zmk_battery_history_entry *entry) {
+    if (index < 0 || index >= count) {
+        return -EINVAL;
+    }
+    if (index == count - 1) {
+        *entry = newest;
+        return 0;
+    }
+
+    if (!cursor.valid || cursor.index > index) {
+        cursor.valid = true;
+        cursor.index = 0;
+        cursor.word = head;
+        cursor.timestamp = oldest_timestamp;
+    }
+    while (cursor.index < index) {
+        cursor.word =
+            (cursor.word + (is_escape(words[cursor.word]) ? ESCAPE_WORDS : 1)) % CAPACITY;
+        cursor.timestamp = get_timestamp(cursor.word, cursor.timestamp);
+        cursor.index++;
+    }
+
+    entry->timestamp = cursor.timestamp;
+    entry->battery_level = get_level(cursor.word);
+    return 0;
+}
+
+void battery_history_compact_clear(void) {
+    head = 0;
+    used = 0;
+    count = 0;
+    cursor.valid = false;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - compact 2-byte in-RAM entry ring
+ */
+
+#pragma once
+
+#include <zmk/battery_history/battery_history.h>
+
+/**
+ * @brief Append an entry, dropping the oldest entries when the ring is full
+ * Timestamps of entries following a short gap are rounded to the delta unit.
+ * @param entry Entry to append
+ */
+void battery_history_compact_push(const struct zmk_battery_history_entry *entry);
+
+/**
+ * @brief Get the number of entries held by the ring
+ */
+int battery_history_compact_count(void);
+
+/**
+ * @brief Get an entry by logical index (0 = oldest)
+ * Sequential reads are O(1), random reads walk the ring from the oldest entry.
+ * @return 0 on success, -EINVAL if the index is out of range
+ */
+int battery_history_compact_get(int index, struct zmk_battery_history_entry *entry);
+
+/**
+ * @brief Drop every entry
+ */
+void battery_history_compact_clear(void);
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - timeline continuing across reboots
+ *
+ * Entries are timestamped in seconds on a 32-bit timeline, the uptime plus the
+ * epoch of the current boot. The timeline only has to increase, it does not
+ * follow wall-clock time, so the epoch is never written at every entry.
+ * Instead a reserved time an hour ahead is kept under
+ * battery_history_epoch/t, and renewed before entries reaching it are written
+ * to storage. The next boot starts at the reserved time, after every stored
+ * entry, and the time spent powered off or asleep is not accounted for.
+ *
+ * With the RAM backend nothing is stored and the timeline is the uptime.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/crc.h>
+
+#include "battery_history_backend.h"
+#include "battery_history_epoch.h"
+#include "battery_history_stats.h"
+
+LOG_MODULE_DECLARE(zmk_battery_history, CONFIG_ZMK_LOG_LEVEL);
+
+// Time reserved ahead by a single write of the epoch record
+#define EPOCH_RESERVE_SEC (60 * 60)
+
+// Timeline time at uptime zero
+static uint32_t boot_epoch = 0;
+
+#ifndef CONFIG_ZMK_BATTERY_HISTORY_STORAGE_RAM
+struct epoch_record {
+    uint16_t crc;      // CRC16 of the reserved time
+    uint32_t reserved; // The next boot starts at this time
+} __packed;
+
+// Stored reserved time, entries before it are safe to write
+static uint32_t reserved_until = 0;
+static bool epoch_loaded = false;
+#endif
+
+static uint32_t get_uptime_sec(void) { return (uint32_t)(k_uptime_get() / 1000); }
+
+uint32_t battery_history_epoch_now(void) { return boot_epoch + get_uptime_sec(); }
+
+uint32_t battery_history_epoch_boot(void) { return boot_epoch; }
+
+void battery_history_epoch_advance(uint32_t timestamp) {
+    uint32_t now = battery_history_epoch_now();
+
+    if (now <= timestamp) {
+        boot_epoch += timestamp + 1 - now;
+    }
+}
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_STORAGE_RAM
+int battery_history_epoch_reserve(void) { return 0; }
+
+bool battery_history_epoch_loaded(void) { return true; }
+#else
+int battery_history_epoch_reserve(void) {
+    struct epoch_record record;
+    uint32_t now = battery_history_epoch_now();
+
+    if (!epoch_loaded) {
+        return -EAGAIN;
+    }
+    if (now < reserved_until) {
+        return 0;
+    }
+    record.reserved = now + EPOCH_RESERVE_SEC;
+    record.crc = crc16_ccitt(0xffff, (const uint8_t *)&record.reserved, sizeof(record.reserved));
+
+    int rc = settings_save_one("battery_history_epoch/t", &record, sizeof(record));
+    if (rc < 0) {
+        LOG_ERR("Failed to save battery history epoch: %d", rc);
+        return rc;
+    }
+    battery_history_stats_add_write(1, sizeof(record));
+    reserved_until = record.reserved;
+    return 0;
+}
+
+bool battery_history_epoch_loaded(void) { return epoch_loaded; }
+
+static int epoch_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+                              void *cb_arg) {
+    struct epoch_record record;
+
+    if (strcmp(name, "t")) {
+        return -ENOENT;
+    }
+    if (len != sizeof(record)) {
+        return -EINVAL;
+    }
+    int rc = read_cb(cb_arg, &record, sizeof(record));
+    if (rc < 0) {
+        return rc;
+    }
+    if (record.crc !=
+        crc16_ccitt(0xffff, (const uint8_t *)&record.reserved, sizeof(record.reserved))) {
+        // Restored entries still advance the timeline past themselves
+        LOG_WRN("Discarding corrupt battery history epoch");
+        return 0;
+    }
+    reserved_until = record.reserved;
+    return 0;
+}
+
+static int epoch_settings_commit(void) {
+    // Uptime before the commit belongs to this boot too
+    battery_history_epoch_advance(reserved_until > 0 ? reserved_until - 1 : 0);
+    epoch_loaded = true;
+    LOG_INF("Battery history timeline at %u", battery_history_epoch_now());
+    battery_history_start_recording();
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(battery_history_epoch, "battery_history_epoch", NULL,
+                               epoch_settings_set, epoch_settings_commit, NULL);
+#endif
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - timeline continuing across reboots
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Current time on the history timeline in seconds
+ * Increases across reboots, so entries of all boots form a single series.
+ */
+uint32_t battery_history_epoch_now(void);
+
+/**
+ * @brief Time of the current boot on the history timeline in seconds
+ */
+uint32_t battery_history_epoch_boot(void);
+
+/**
+ * @brief Make sure the next boot starts after the current time
+ * Called before entries are written to storage, it writes a record about once
+ * an hour of uptime.
+ * @return 0 on success, negative error code on failure
+ */
+int battery_history_epoch_reserve(void);
+
+/**
+ * @brief Move the current time after a restored timestamp
+ */
+void battery_history_epoch_advance(uint32_t timestamp);
+
+/**
+ * @brief Whether the stored epoch is loaded and the current time is final
+ */
+bool battery_history_epoch_loaded(void);
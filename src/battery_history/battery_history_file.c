@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - append-only files on a Zephyr file system
+ *
+ * Entries are appended as fixed-size records with a CRC8 to two segment
+ * files: "<path>.1" receives new entries and, once it holds half of the
+ * configured capacity, replaces "<path>.0". The history therefore always
+ * covers between half and all of ZMK_BATTERY_HISTORY_FILE_MAX_ENTRIES, and
+ * entry N is found at a fixed offset without reading the others. Reads go
+ * through a small chunk cache, so the RAM used does not depend on the length
+ * of the history. Reads come from the RPC thread while the system work queue
+ * appends, so the segments and the cache are guarded by a mutex.
+ */
+
+#include <string.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include "battery_history_backend.h"
+
+LOG_MODULE_DECLARE(zmk_battery_history, CONFIG_ZMK_LOG_LEVEL);
+
+#define SEGMENT_ENTRIES (CONFIG_ZMK_BATTERY_HISTORY_FILE_MAX_ENTRIES / 2)
+// Records read or written by a single file operation
+#define CHUNK_RECORDS 32
+
+struct file_record {
+    struct zmk_battery_history_entry entry;
+    uint8_t crc; // CRC8 of the entry
+} __packed;
+
+// Segment 0 holds the older entries, segment 1 receives new ones
+static const char *const segment_paths[] = {
+    CONFIG_ZMK_BATTERY_HISTORY_FILE_PATH ".0",
+    CONFIG_ZMK_BATTERY_HISTORY_FILE_PATH ".1",
+};
+static int segment_counts[ARRAY_SIZE(segment_paths)];
+
+static struct battery_history_backend_stats stats;
+
+// Guards the segment files, segment_counts and the cache
+static K_MUTEX_DEFINE(file_lock);
+
+// Most recently read chunk of records
+static struct {
+    int index; // Index of the first cached entry
+    int count;
+    struct file_record records[CHUNK_RECORDS];
+} cache;
+
+static uint8_t get_entry_crc(const struct zmk_battery_history_entry *entry) {
+    return crc8_ccitt(0xff, entry, sizeof(*entry));
+}
+
+/**
+ * Cut a segment down to a number of records
+ */
+static int truncate_segment(int segment, int count) {
+    struct fs_file_t file;
+
+    fs_file_t_init(&file);
+    int rc = fs_open(&file, segment_paths[segment], FS_O_RDWR);
+    if (rc < 0) {
+        return rc;
+    }
+    rc = fs_truncate(&file, count * sizeof(struct file_record));
+    fs_close(&file);
+    if (rc < 0) {
+        return rc;
+    }
+    segment_counts[segment] = count;
+    return 0;
+}
+
+/**
+ * Count the complete records of a segment, cutting off a record torn by an
+ * interrupted append
+ */
+static int sync_segment(int segment) {
+    struct fs_dirent dirent;
+
+    int rc = fs_stat(segment_paths[segment], &dirent);
+    if (rc == -ENOENT) {
+        segment_counts[segment] = 0;
+        return 0;
+    }
+    if (rc < 0) {
+        return rc;
+    }
+
+    segment_counts[segment] = dirent.size / sizeof(struct file_record);
+    if (dirent.size % sizeof(struct file_record) == 0) {
+        return 0;
+    }
+
+    LOG_WRN("Truncating torn battery history record in %s", segment_paths[segment]);
+    return truncate_segment(segment, segment_counts[segment]);
+}
+
+static int read_chunk(int index) {
+    struct fs_file_t file;
+    int segment = index < segment_counts[0] ? 0 : 1;
+    int offset = segment == 0 ? index : index - segment_counts[0];
+    int n = MIN(CHUNK_RECORDS, segment_counts[segment] - offset);
+
+    cache.count = 0;
+    fs_file_t_init(&file);
+    int rc = fs_open(&file, segment_paths[segment], FS_O_READ);
+    if (rc < 0) {
+        return rc;
+    }
+    rc = fs_seek(&file, offset * sizeof(struct file_record), FS_SEEK_SET);
+    if (rc == 0) {
+        rc = fs_read(&file, cache.records, n * sizeof(struct file_record));
+    }
+    fs_close(&file);
+    if (rc < 0) {
+        return rc;
+    }
+
+    cache.index = index;
+    cache.count = rc / sizeof(struct file_record);
+    return cache.count > 0 ? 0 : -EIO;
+}
+
+static int get_stored_count(void) { return segment_counts[0] + segment_counts[1]; }
+
+static int read_stored(int index, struct zmk_battery_history_entry *entry) {
+    if (index < 0 || index >= get_stored_count()) {
+        return -EINVAL;
+    }
+    if (index < cache.index || index >= cache.index + cache.count) {
+        int rc = read_chunk(index);
+        if (rc < 0) {
+            LOG_ERR("Failed to read battery history entry %d: %d", index, rc);
+            return rc;
+        }
+    }
+
+    const struct file_record *record = &cache.records[index - cache.index];
+    if (record->crc != get_entry_crc(&record->entry)) {
+        return -EBADMSG;
+    }
+    *entry = record->entry;
+    return 0;
+}
+
+static int file_backend_get_stored_count(void) {
+    k_mutex_lock(&file_lock, K_FOREVER);
+    int count = get_stored_count();
+    k_mutex_unlock(&file_lock);
+    return count;
+}
+
+static int file_backend_read_stored(int index, struct zmk_battery_history_entry *entry) {
+    k_mutex_lock(&file_lock, K_FOREVER);
+    int rc = read_stored(index, entry);
+    k_mutex_unlock(&file_lock);
+    return rc;
+}
+
+/**
+ * Open the history files and replay the newest entries
+ * Only the entries that fit into the RAM ring are replayed, older ones are
+ * read from the files on demand.
+ */
+static int load_segments(void) {
+    for (int segment = 0; segment < ARRAY_SIZE(segment_paths); segment++) {
+        int rc = sync_segment(segment);
+        if (rc < 0) {
+            LOG_ERR("Failed to open %s: %d", segment_paths[segment], rc);
+            return rc;
+        }
+    }
+
+    int total = get_stored_count();
+    for (int i = MAX(0, total - BATTERY_HISTORY_RING_ENTRIES); i < total; i++) {
+        struct zmk_battery_history_entry entry;
+        int rc = read_stored(i, &entry);
+        if (rc == -EBADMSG) {
+            LOG_WRN("Discarding corrupt battery history entry %d", i);
+            battery_history_count_discarded();
+            continue;
+        }
+        if (rc < 0) {
+            return rc;
+        }
+        battery_history_restore_entry(&entry);
+    }
+
+    LOG_INF("Battery history file opened: %d entries", total);
+    return 0;
+}
+
+static int file_backend_load(void) {
+    k_mutex_lock(&file_lock, K_FOREVER);
+    int rc = load_segments();
+    k_mutex_unlock(&file_lock);
+    return rc;
+}
+
+/**
+ * Start a new active segment, dropping the older half of the history
+ */
+static int rotate_segments(void) {
+    int rc = fs_unlink(segment_paths[0]);
+    if (rc < 0 && rc != -ENOENT) {
+        return rc;
+    }
+    segment_counts[0] = 0;
+    cache.count = 0;
+
+    rc = fs_rename(segment_paths[1], segment_paths[0]);
+    if (rc < 0) {
+        return rc;
+    }
+    segment_counts[0] = segment_counts[1];
+    segment_counts[1] = 0;
+    return 0;
+}
+
+static int append_entries(const struct zmk_battery_history_entry *entries, int count) {
+    struct file_record records[CHUNK_RECORDS];
+    struct fs_file_t file;
+    int written = 0;
+
+    while (count > 0) {
+        if (segment_counts[1] >= SEGMENT_ENTRIES) {
+            int rc = rotate_segments();
+            if (rc < 0) {
+                LOG_ERR("Failed to rotate battery history files: %d", rc);
+                return rc;
+            }
+        }
+
+        int n = MIN(MIN(count, CHUNK_RECORDS), SEGMENT_ENTRIES - segment_counts[1]);
+        for (int i = 0; i < n; i++) {
+            records[i].entry = entries[i];
+            records[i].crc = get_entry_crc(&entries[i]);
+        }
+
+        fs_file_t_init(&file);
+        int rc = fs_open(&file, segment_paths[1], FS_O_CREATE | FS_O_WRITE | FS_O_APPEND);
+        if (rc == 0) {
+            rc = fs_write(&file, records, n * sizeof(struct file_record));
+            fs_close(&file);
+        }
+        if (rc >= 0 && rc != (int)(n * sizeof(struct file_record))) {
+            rc = -EIO;
+        }
+        if (rc < 0) {
+            LOG_ERR("Failed to append to %s: %d", segment_paths[1], rc);
+            // Drop whatever part of the chunk was written, it is retried as
+            // a whole on the next save
+            cache.count = 0;
+            truncate_segment(1, segment_counts[1]);
+            return rc;
+        }
+
+        segment_counts[1] += n;
+        stats.records_written += n;
+        stats.bytes_written += n * sizeof(struct file_record);
+        entries += n;
+        count -= n;
+        written++;
+    }
+    return written;
+}
+
+static int file_backend_append(int index, const struct zmk_battery_history_entry *entries,
+                               int count) {
+    k_mutex_lock(&file_lock, K_FOREVER);
+    int rc = append_entries(entries, count);
+    k_mutex_unlock(&file_lock);
+    return rc;
+}
+
+static int clear_segments(void) {
+    cache.count = 0;
+    for (int segment = 0; segment < ARRAY_SIZE(segment_paths); segment++) {
+        int rc = fs_unlink(segment_paths[segment]);
+        if (rc < 0 && rc != -ENOENT) {
+            LOG_ERR("Failed to delete %s: %d", segment_paths[segment], rc);
+            return rc;
+        }
+        segment_counts[segment] = 0;
+    }
+    return 0;
+}
+
+static int file_backend_clear(void) {
+    k_mutex_lock(&file_lock, K_FOREVER);
+    int rc = clear_segments();
+    k_mutex_unlock(&file_lock);
+    return rc;
+}
+
+static void file_backend_get_stats(struct battery_history_backend_stats *out) { *out = stats; }
+
+const struct battery_history_backend battery_history_backend = {
+    .name = "file",
+    .load = file_backend_load,
+    .append = file_backend_append,
+    .clear = file_backend_clear,
+    .get_stats = file_backend_get_stats,
+    .get_stored_count = file_backend_get_stored_count,
+    .read_stored = file_backend_read_stored,
+};
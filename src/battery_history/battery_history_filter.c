@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - level hysteresis filter
+ */
+
+#include <stdlib.h>
+
+#include "battery_history_filter.h"
+
+void battery_history_filter_init(struct battery_history_filter *filter, int deadband,
+                                 int64_t dwell_ms, bool monotonic) {
+    filter->deadband = deadband;
+    filter->dwell_ms = dwell_ms;
+    filter->monotonic = monotonic;
+    filter->level = -1;
+    filter->candidate_ms = -1;
+    filter->direction = 0;
+}
+
+int battery_history_filter_update(struct battery_history_filter *filter, int64_t now_ms,
+                                  int reading, bool charging) {
+    int change = reading - filter->level;
+
+    if (filter->level < 0 || abs(change) > filter->deadband) {
+        filter->level = reading;
+        filter->candidate_ms = -1;
+        return filter->level;
+    }
+    if (change == 0 || (change > 0 && filter->monotonic && !charging)) {
+        // Back at the accepted level, or jitter against the discharge
+        filter->candidate_ms = -1;
+        return filter->level;
+    }
+
+    int direction = change > 0 ? 1 : -1;
+    if (filter->candidate_ms < 0 || direction != filter->direction) {
+        filter->candidate_ms = now_ms;
+        filter->direction = direction;
+    }
+    if (now_ms - filter->candidate_ms >= filter->dwell_ms) {
+        filter->level = reading;
+        filter->candidate_ms = -1;
+    }
+    return filter->level;
+}
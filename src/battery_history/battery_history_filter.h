@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - level hysteresis filter
+ *
+ * Battery readings jitter by a percent or so, and a reading bouncing between
+ * two levels would otherwise be recorded, and often saved, on every flap. A
+ * reading within the dead-band of the accepted level is only accepted once
+ * the level stayed on that side of it for the dwell time, a reading beyond
+ * the dead-band is accepted right away. Optionally, rises within the
+ * dead-band are never accepted while discharging.
+ *
+ * This file has no Zephyr dependencies so it can be tested on the host.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct battery_history_filter {
+    int deadband;         // Changes up to this many percent have to dwell
+    int64_t dwell_ms;     // Time a change within the dead-band has to persist
+    bool monotonic;       // Never accept rises within the dead-band while discharging
+    int level;            // Accepted level, negative before the first reading
+    int64_t candidate_ms; // Uptime readings started to differ, negative while they do not
+    int direction;        // Sign of the pending change
+};
+
+/**
+ * @brief Set up a filter accepting its first reading as is
+ */
+void battery_history_filter_init(struct battery_history_filter *filter, int deadband,
+                                 int64_t dwell_ms, bool monotonic);
+
+/**
+ * @brief Feed a reading through the filter
+ * @param now_ms Current uptime, never decreasing
+ * @param reading Battery level read
+ * @param charging Whether the battery may be charging
+ * @return Accepted battery level
+ */
+int battery_history_filter_update(struct battery_history_filter *filter, int64_t now_ms,
+                                  int reading, bool charging);
@@ -15,7 +15,9 @@
 #include <zmk/battery_history/battery_history.pb.h>
 #include <zmk/battery_history/battery_history.h>
 
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 /**
@@ -42,6 +44,15 @@ static int handle_get_history_request(const zmk_battery_history_GetBatteryHistor
                                       zmk_battery_history_Response *resp);
 static int handle_clear_history_request(const zmk_battery_history_ClearBatteryHistoryRequest *req,
                                         zmk_battery_history_Response *resp);
+static int handle_get_archive_request(const zmk_battery_history_GetBatteryArchiveRequest *req,
+                                      zmk_battery_history_Response *resp);
+static int
+handle_get_storage_stats_request(const zmk_battery_history_GetStorageStatsRequest *req,
+                                 zmk_battery_history_Response *resp);
+static int handle_get_sessions_request(const zmk_battery_history_GetSessionsRequest *req,
+                                       zmk_battery_history_Response *resp);
+static int handle_get_voltage_request(const zmk_battery_history_GetVoltageRequest *req,
+                                      zmk_battery_history_Response *resp);
 
 /**
  * Main request handler for the battery history RPC subsystem.
@@ -73,6 +84,18 @@ static bool battery_history_rpc_handle_request(const zmk_custom_CallRequest *raw
     case zmk_battery_history_Request_clear_history_tag:
         rc = handle_clear_history_request(&req.request_type.clear_history, resp);
         break;
+    case zmk_battery_history_Request_get_archive_tag:
+        rc = handle_get_archive_request(&req.request_type.get_archive, resp);
+        break;
+    case zmk_battery_history_Request_get_storage_stats_tag:
+        rc = handle_get_storage_stats_request(&req.request_type.get_storage_stats, resp);
+        break;
+    case zmk_battery_history_Request_get_sessions_tag:
+        rc = handle_get_sessions_request(&req.request_type.get_sessions, resp);
+        break;
+    case zmk_battery_history_Request_get_voltage_tag:
+        rc = handle_get_voltage_request(&req.request_type.get_voltage, resp);
+        break;
     default:
         LOG_WRN("Unsupported battery history request type: %d", req.which_request_type);
         rc = -1;
@@ -92,7 +115,8 @@ static bool battery_history_rpc_handle_request(const zmk_custom_CallRequest *raw
  */
 static int handle_get_history_request(const zmk_battery_history_GetBatteryHistoryRequest *req,
                                       zmk_battery_history_Response *resp) {
-    LOG_DBG("Received get battery history request (include_metadata=%d)", req->include_metadata);
+    LOG_DBG("Received get battery history request (include_metadata=%d, offset=%d)",
+            req->include_metadata, req->has_offset ? req->offset : -1);
 
     zmk_battery_history_GetBatteryHistoryResponse result =
         zmk_battery_history_GetBatteryHistoryResponse_init_zero;
@@ -103,11 +127,18 @@ static int handle_get_history_request(const zmk_battery_history_GetBatteryHistor
         result.current_battery_level = (uint32_t)current_level;
     }
 
-    // Get history entries
+    // Get history entries, a page from the requested offset or the newest
+    // ones that fit into the response
+    uint32_t start_cycles = k_cycle_get_32();
     int count = zmk_battery_history_get_count();
+    int first = req->has_offset ? (int)MIN(req->offset, (uint32_t)count)
+                                : MAX(0, count - (int)ARRAY_SIZE(result.entries));
+    result.total_entries = (uint32_t)count;
+    result.offset = (uint32_t)first;
     result.entries_count = 0;
 
-    for (int i = 0; i < count && i < CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES; i++) {
+    int i;
+    for (i = first; i < count && result.entries_count < ARRAY_SIZE(result.entries); i++) {
         struct zmk_battery_history_entry entry;
         if (zmk_battery_history_get_entry(i, &entry) == 0) {
             result.entries[result.entries_count].timestamp = entry.timestamp;
@@ -115,6 +146,10 @@ static int handle_get_history_request(const zmk_battery_history_GetBatteryHistor
             result.entries_count++;
         }
     }
+    result.next_offset = (uint32_t)i;
+    // Read latency of a page, to compare the RAM ring with reads from storage
+    LOG_DBG("Read %d battery history entries in %u us", result.entries_count,
+            k_cyc_to_us_floor32(k_cycle_get_32() - start_cycles));
 
     // Include metadata if requested
     if (req->include_metadata) {
@@ -122,6 +157,9 @@ static int handle_get_history_request(const zmk_battery_history_GetBatteryHistor
         snprintf(result.metadata.device_name, sizeof(result.metadata.device_name), "ZMK Keyboard");
         result.metadata.recording_interval_minutes = (uint32_t)zmk_battery_history_get_interval();
         result.metadata.max_entries = (uint32_t)zmk_battery_history_get_max_entries();
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_ARCHIVE
+        result.metadata.archive_tiers = (uint32_t)zmk_battery_history_get_archive_tier_count();
+#endif
     }
 
     LOG_INF("Returning battery history: %d entries, current level: %d%%", result.entries_count,
@@ -151,3 +189,154 @@ static int handle_clear_history_request(const zmk_battery_history_ClearBatteryHi
     resp->response_type.clear_history = result;
     return 0;
 }
+
+/**
+ * Handle GetBatteryArchiveRequest and populate the response.
+ */
+static int handle_get_archive_request(const zmk_battery_history_GetBatteryArchiveRequest *req,
+                                      zmk_battery_history_Response *resp) {
+    LOG_DBG("Received get battery archive request (tier=%d, offset=%d)", req->tier, req->offset);
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_ARCHIVE
+    zmk_battery_history_GetBatteryArchiveResponse result =
+        zmk_battery_history_GetBatteryArchiveResponse_init_zero;
+
+    int resolution = zmk_battery_history_get_archive_resolution(req->tier);
+    if (resolution < 0) {
+        return resolution;
+    }
+    int total = zmk_battery_history_get_archive_row_count(req->tier);
+
+    result.tier = req->tier;
+    result.resolution_minutes = (uint32_t)resolution;
+    result.total_rows = (uint32_t)total;
+    result.offset = MIN(req->offset, (uint32_t)total);
+    result.rows_count = 0;
+
+    for (int i = result.offset; i < total && result.rows_count < ARRAY_SIZE(result.rows); i++) {
+        struct zmk_battery_history_archive_row row;
+        if (zmk_battery_history_get_archive_row(req->tier, i, &row) == 0) {
+            result.rows[result.rows_count].minutes = row.minutes;
+            result.rows[result.rows_count].min_level = row.min_level;
+            result.rows[result.rows_count].avg_level = row.avg_level;
+            result.rows[result.rows_count].max_level = row.max_level;
+            result.rows_count++;
+        }
+    }
+
+    LOG_INF("Returning battery archive tier %d: %d of %d rows", req->tier, result.rows_count,
+            total);
+
+    resp->which_response_type = zmk_battery_history_Response_get_archive_tag;
+    resp->response_type.get_archive = result;
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+/**
+ * Handle GetStorageStatsRequest and populate the response.
+ */
+static int
+handle_get_storage_stats_request(const zmk_battery_history_GetStorageStatsRequest *req,
+                                 zmk_battery_history_Response *resp) {
+    LOG_DBG("Received get storage stats request");
+
+    struct zmk_battery_history_storage_stats stats;
+    zmk_battery_history_get_storage_stats(&stats);
+
+    zmk_battery_history_GetStorageStatsResponse result =
+        zmk_battery_history_GetStorageStatsResponse_init_zero;
+    result.saves = stats.saves;
+    result.failed_saves = stats.failed_saves;
+    result.records_written = stats.records_written;
+    result.bytes_written = stats.bytes_written;
+    result.recoveries = stats.recoveries;
+    result.min_save_us = stats.min_save_us;
+    result.avg_save_us = stats.avg_save_us;
+    result.max_save_us = stats.max_save_us;
+    result.max_sleep_us = stats.max_sleep_us;
+    result.wakeups = stats.wakeups;
+
+    resp->which_response_type = zmk_battery_history_Response_get_storage_stats_tag;
+    resp->response_type.get_storage_stats = result;
+    return 0;
+}
+
+/**
+ * Handle GetSessionsRequest and populate the response.
+ */
+static int handle_get_sessions_request(const zmk_battery_history_GetSessionsRequest *req,
+                                       zmk_battery_history_Response *resp) {
+    LOG_DBG("Received get sessions request");
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_SESSIONS
+    zmk_battery_history_GetSessionsResponse result =
+        zmk_battery_history_GetSessionsResponse_init_zero;
+
+    int count = zmk_battery_history_get_session_count();
+    // The newest sessions if more are kept than fit
+    int start = MAX(0, count - (int)ARRAY_SIZE(result.sessions));
+
+    result.sessions_count = 0;
+    for (int i = start; i < count; i++) {
+        struct zmk_battery_history_session session;
+        if (zmk_battery_history_get_session(i, &session) == 0) {
+            result.sessions[result.sessions_count].start = session.start;
+            result.sessions[result.sessions_count].uptime = session.uptime;
+            result.sessions[result.sessions_count].prior_uptime = session.prior_uptime;
+            result.sessions[result.sessions_count].boot = session.boot;
+            result.sessions[result.sessions_count].reason =
+                (zmk_battery_history_BootReason)session.reason;
+            result.sessions[result.sessions_count].last_level = session.last_level;
+            result.sessions_count++;
+        }
+    }
+
+    LOG_INF("Returning %d boot sessions", result.sessions_count);
+
+    resp->which_response_type = zmk_battery_history_Response_get_sessions_tag;
+    resp->response_type.get_sessions = result;
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+/**
+ * Handle GetVoltageRequest and populate the response.
+ */
+static int handle_get_voltage_request(const zmk_battery_history_GetVoltageRequest *req,
+                                      zmk_battery_history_Response *resp) {
+    LOG_DBG("Received get voltage request: offset=%d", req->offset);
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_MILLIVOLTS
+    zmk_battery_history_GetVoltageResponse result =
+        zmk_battery_history_GetVoltageResponse_init_zero;
+
+    int total = zmk_battery_history_get_voltage_count();
+
+    result.total_samples = (uint32_t)total;
+    result.offset = MIN(req->offset, (uint32_t)total);
+    result.samples_count = 0;
+
+    for (int i = result.offset; i < total && result.samples_count < ARRAY_SIZE(result.samples);
+         i++) {
+        struct zmk_battery_history_voltage_sample sample;
+        if (zmk_battery_history_get_voltage_sample(i, &sample) == 0) {
+            result.samples[result.samples_count].timestamp = sample.timestamp;
+            result.samples[result.samples_count].millivolts = sample.millivolts;
+            result.samples_count++;
+        }
+    }
+
+    LOG_INF("Returning %d of %d voltage samples", result.samples_count, total);
+
+    resp->which_response_type = zmk_battery_history_Response_get_voltage_tag;
+    resp->response_type.get_voltage = result;
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
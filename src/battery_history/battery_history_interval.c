@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - adaptive recording interval
+ */
+
+#include <stdlib.h>
+
+#include "battery_history_interval.h"
+
+// Samples per percent step at the observed rate
+#define SAMPLES_PER_STEP 2
+
+void battery_history_interval_init(struct battery_history_interval *interval, int64_t min_ms,
+                                   int64_t max_ms) {
+    interval->min_ms = min_ms;
+    interval->max_ms = max_ms > min_ms ? max_ms : min_ms;
+    interval->step_ms = 0;
+    interval->changed_ms = 0;
+    interval->level = -1;
+}
+
+int64_t battery_history_interval_next(struct battery_history_interval *interval, int64_t now_ms,
+                                      int level) {
+    if (interval->level < 0) {
+        interval->level = level;
+        interval->changed_ms = now_ms;
+    } else if (level != interval->level) {
+        interval->step_ms = (now_ms - interval->changed_ms) / abs(level - interval->level);
+        interval->level = level;
+        interval->changed_ms = now_ms;
+    }
+
+    // Flat for longer than the last step took, the drain slowed down
+    int64_t step_ms = now_ms - interval->changed_ms;
+    if (step_ms < interval->step_ms) {
+        step_ms = interval->step_ms;
+    }
+
+    int64_t delay_ms = step_ms / SAMPLES_PER_STEP;
+    if (delay_ms < interval->min_ms) {
+        return interval->min_ms;
+    }
+    if (delay_ms > interval->max_ms) {
+        return interval->max_ms;
+    }
+    return delay_ms;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - adaptive recording interval
+ *
+ * The level is sampled twice per percent step at the observed drain rate.
+ * The rate is the time the last level change took per percent, or the time
+ * the level has been flat since, whichever is longer. So the interval grows
+ * while the level sits flat and shrinks as soon as the level moves faster,
+ * within the configured bounds.
+ *
+ * This file has no Zephyr dependencies so it can be tested on the host.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+struct battery_history_interval {
+    int64_t min_ms;     // Shortest interval
+    int64_t max_ms;     // Longest interval
+    int64_t step_ms;    // Time per percent of the last level change, 0 before any
+    int64_t changed_ms; // Uptime the current level was first sampled
+    int level;          // Last sampled level, negative before the first sample
+};
+
+/**
+ * @brief Set up an interval starting at its lower bound
+ */
+void battery_history_interval_init(struct battery_history_interval *interval, int64_t min_ms,
+                                   int64_t max_ms);
+
+/**
+ * @brief Account a sample and get the delay until the next one
+ * @param now_ms Current uptime, never decreasing
+ * @param level Sampled battery level
+ * @return Delay in ms, within the bounds
+ */
+int64_t battery_history_interval_next(struct battery_history_interval *interval, int64_t now_ms,
+                                      int level);
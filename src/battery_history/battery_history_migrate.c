@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - migration from the per-entry settings layout
+ *
+ * Devices upgraded from the per-entry layout still hold battery_history/eN
+ * records together with head/count keys or an h0/h1 header. While settings
+ * load, these keys are only noted. Afterwards a work item on the system work
+ * queue, where the ring is accessed by everything else too, reads the records
+ * in chunks, appends them to the active backend and deletes them. Their
+ * per-boot timestamps are rebased onto the timeline on the way. The format
+ * version stored under battery_history/format lets later boots finish loading
+ * without queueing any work.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include "battery_history_backend.h"
+#include "battery_history_epoch.h"
+#include "battery_history_migrate.h"
+#include "battery_history_settings.h"
+#include "battery_history_timeline.h"
+
+LOG_MODULE_DECLARE(zmk_battery_history, CONFIG_ZMK_LOG_LEVEL);
+
+#define MAX_ENTRIES CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES
+
+// Per-entry records read per pass over the settings subtree
+#define MIGRATE_CHUNK_ENTRIES 16
+
+// Version of the stored format, bumped whenever a layout changes
+#define FORMAT_VERSION 1
+
+/**
+ * Format of the stored history, written once no older records are left
+ */
+struct format_record {
+    uint8_t version;
+    char layout[15]; // Backend name, not NUL-terminated
+} __packed;
+
+// Whether the stored format is the one of the active layout
+static bool format_current = false;
+
+// Keys holding the ring position of the per-entry layout
+static const char *const position_keys[] = {"head", "count", "h0", "h1"};
+static uint8_t found_position_keys = 0;
+
+// Slots holding a per-entry record
+static ATOMIC_DEFINE(found_entries, MAX_ENTRIES);
+static bool legacy_found = false;
+
+// Ring position of the per-entry layout
+static uint32_t header_generation = 0;
+static int header_head = 0;
+static int header_count = 0;
+static int legacy_head = -1;
+static int legacy_count = -1;
+
+struct migrate_chunk {
+    int first; // Slot of the first entry
+    int count;
+    struct zmk_battery_history_entry entries[MIGRATE_CHUNK_ENTRIES];
+    uint32_t loaded; // Bitmask of the valid entries read
+    uint32_t legacy; // Bitmask of the entries with per-boot timestamps
+};
+
+static uint16_t get_record_crc(const void *record, size_t len) {
+    return crc16_ccitt(0xffff, (const uint8_t *)record + sizeof(uint16_t),
+                       len - sizeof(uint16_t));
+}
+
+static int load_header(size_t len, settings_read_cb read_cb, void *cb_arg) {
+    struct history_header header;
+
+    if (len != sizeof(header)) {
+        return -EINVAL;
+    }
+    int rc = read_cb(cb_arg, &header, sizeof(header));
+    if (rc < 0) {
+        return rc;
+    }
+    if (header.crc == get_record_crc(&header, sizeof(header)) &&
+        header.version == HEADER_FORMAT_VERSION && header.head < MAX_ENTRIES &&
+        header.count <= MAX_ENTRIES && header.generation > header_generation) {
+        header_generation = header.generation;
+        header_head = header.head;
+        header_count = header.count;
+    }
+    return 0;
+}
+
+static int load_position(int key, size_t len, settings_read_cb read_cb, void *cb_arg) {
+    found_position_keys |= BIT(key);
+    legacy_found = true;
+    if (key >= 2) {
+        return load_header(len, read_cb, cb_arg);
+    }
+
+    int *value = key == 0 ? &legacy_head : &legacy_count;
+    if (len != sizeof(*value)) {
+        return -EINVAL;
+    }
+    return read_cb(cb_arg, value, sizeof(*value));
+}
+
+int battery_history_migrate_set(const char *name, size_t len, settings_read_cb read_cb,
+                                void *cb_arg) {
+    if (!strcmp(name, "format")) {
+        struct format_record record;
+        const char *layout = battery_history_backend.name;
+
+        if (len == 0 || len > sizeof(record)) {
+            return -EINVAL;
+        }
+        int rc = read_cb(cb_arg, &record, len);
+        if (rc < 0) {
+            return rc;
+        }
+        format_current = record.version == FORMAT_VERSION && len - 1 == strlen(layout) &&
+                         !memcmp(record.layout, layout, len - 1);
+        return 0;
+    }
+
+    for (int i = 0; i < (int)ARRAY_SIZE(position_keys); i++) {
+        if (!strcmp(name, position_keys[i])) {
+            return load_position(i, len, read_cb, cb_arg);
+        }
+    }
+
+    // Entries are only noted here and read by the migration
+    if (name[0] == 'e') {
+        int idx = atoi(name + 1);
+        if (idx >= 0 && idx < MAX_ENTRIES) {
+            atomic_set_bit(found_entries, idx);
+            legacy_found = true;
+            return 0;
+        }
+    }
+
+    return -ENOENT;
+}
+
+/**
+ * Ring position of the per-entry records, the header wins over head/count
+ */
+static bool get_legacy_position(int *head, int *count) {
+    if (header_generation > 0) {
+        *head = header_head;
+        *count = header_count;
+        return true;
+    }
+    if (legacy_head >= 0 && legacy_head < MAX_ENTRIES && legacy_count >= 0 &&
+        legacy_count <= MAX_ENTRIES) {
+        *head = legacy_head;
+        *count = legacy_count;
+        return true;
+    }
+    return false;
+}
+
+static int load_chunk_cb(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg,
+                         void *param) {
+    struct migrate_chunk *chunk = param;
+    uint8_t buf[sizeof(struct entry_record)];
+    bool legacy;
+
+    if (key[0] != 'e' || len > sizeof(buf)) {
+        return 0;
+    }
+    int idx = atoi(key + 1);
+    int offset = (idx - chunk->first + MAX_ENTRIES) % MAX_ENTRIES;
+    if (idx < 0 || idx >= MAX_ENTRIES || offset >= chunk->count) {
+        return 0;
+    }
+    if (read_cb(cb_arg, buf, len) < 0) {
+        return 0;
+    }
+    if (decode_entry_record(buf, len, &chunk->entries[offset], &legacy) == 0) {
+        chunk->loaded |= BIT(offset);
+        if (legacy) {
+            chunk->legacy |= BIT(offset);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Append the per-entry records to the ring, oldest first
+ * Returns the number of entries imported or a negative error code
+ */
+static int import_entries(void) {
+    struct battery_history_rebase rebase;
+    int head, count;
+    int imported = 0;
+
+    if (!get_legacy_position(&head, &count)) {
+        LOG_WRN("Per-entry battery history has no ring position, dropping it");
+        return 0;
+    }
+    if (battery_history_ring_count() > 0 || (battery_history_backend.get_stored_count != NULL &&
+                                             battery_history_backend.get_stored_count() > 0)) {
+        // Recorded after the per-entry records, which are stale then
+        LOG_WRN("Battery history already stored by the %s backend, dropping per-entry records",
+                battery_history_backend.name);
+        return 0;
+    }
+
+    uint32_t start = k_cycle_get_32();
+    battery_history_rebase_init(&rebase);
+    for (int i = 0; i < count; i += MIGRATE_CHUNK_ENTRIES) {
+        struct migrate_chunk chunk = {
+            .first = (head + i) % MAX_ENTRIES,
+            .count = MIN(MIGRATE_CHUNK_ENTRIES, count - i),
+        };
+        int rc = settings_load_subtree_direct("battery_history", load_chunk_cb, &chunk);
+        if (rc < 0) {
+            return rc;
+        }
+        for (int j = 0; j < chunk.count; j++) {
+            if (!(chunk.loaded & BIT(j))) {
+                LOG_WRN("Discarding corrupt battery history entry %d",
+                        (chunk.first + j) % MAX_ENTRIES);
+                battery_history_count_discarded();
+                continue;
+            }
+            struct zmk_battery_history_entry *entry = &chunk.entries[j];
+            entry->timestamp = chunk.legacy & BIT(j)
+                                   ? battery_history_rebase_legacy(&rebase, entry->timestamp)
+                                   : battery_history_rebase_current(&rebase, entry->timestamp);
+            battery_history_import_entry(entry);
+            imported++;
+        }
+    }
+    if (imported > 0) {
+        battery_history_epoch_advance(battery_history_rebase_last(&rebase));
+    }
+
+    LOG_INF("Migrated %d battery history entries in %u us", imported,
+            k_cyc_to_us_floor32(k_cycle_get_32() - start));
+    return imported;
+}
+
+static void delete_legacy_keys(void) {
+    char key[32];
+
+    for (int i = 0; i < (int)ARRAY_SIZE(position_keys); i++) {
+        if (found_position_keys & BIT(i)) {
+            snprintf(key, sizeof(key), "battery_history/%s", position_keys[i]);
+            settings_delete(key);
+        }
+    }
+    for (int slot = 0; slot < MAX_ENTRIES; slot++) {
+        if (atomic_test_and_clear_bit(found_entries, slot)) {
+            snprintf(key, sizeof(key), "battery_history/e%d", slot);
+            settings_delete(key);
+        }
+    }
+    found_position_keys = 0;
+    legacy_found = false;
+}
+
+static int save_format(void) {
+    struct format_record record = {.version = FORMAT_VERSION};
+    size_t layout_len = MIN(strlen(battery_history_backend.name), sizeof(record.layout));
+
+    memcpy(record.layout, battery_history_backend.name, layout_len);
+    int rc = settings_save_one("battery_history/format", &record, 1 + layout_len);
+    if (rc < 0) {
+        LOG_ERR("Failed to save battery history format: %d", rc);
+        return rc;
+    }
+    format_current = true;
+    return 0;
+}
+
+/**
+ * Move the per-entry records into the active backend and finish loading
+ */
+static void migrate_work_handler(struct k_work *work) {
+    int imported = legacy_found ? import_entries() : 0;
+
+    battery_history_restore_done();
+    if (imported < 0) {
+        // The records are kept and migrated again on the next boot
+        LOG_ERR("Failed to migrate battery history: %d", imported);
+        return;
+    }
+    if (imported > 0 && battery_history_save_now() < 0) {
+        return;
+    }
+    if (legacy_found) {
+        delete_legacy_keys();
+    }
+    if (!format_current) {
+        save_format();
+    }
+}
+
+K_WORK_DEFINE(migrate_work, migrate_work_handler);
+
+void battery_history_migrate_commit(void) {
+    if (!legacy_found && format_current) {
+        battery_history_restore_done();
+        return;
+    }
+    k_work_submit(&migrate_work);
+}
+
+#ifndef CONFIG_ZMK_BATTERY_HISTORY_STORAGE_BLOCKS
+// The active backend stores nothing in settings, so the subtree is handled here
+static int migrate_settings_commit(void) {
+    battery_history_migrate_commit();
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(battery_history, "battery_history", NULL,
+                               battery_history_migrate_set, migrate_settings_commit, NULL);
+#endif
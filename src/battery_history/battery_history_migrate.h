@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - migration from the per-entry settings layout
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <zephyr/settings/settings.h>
+
+/**
+ * @brief Settings load handler for the battery_history subtree
+ * Notes the records of the per-entry layout and the stored format version.
+ * @return 0 if the key was handled, -ENOENT otherwise
+ */
+int battery_history_migrate_set(const char *name, size_t len, settings_read_cb read_cb,
+                                void *cb_arg);
+
+/**
+ * @brief Finish loading once the settings are loaded
+ * Calls battery_history_restore_done(), from the system work queue after
+ * moving the per-entry records into the active backend if any were
+ * found.
+ */
+void battery_history_migrate_commit(void);
@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - filtered millivolt series
+ *
+ * The state of charge is quantized to whole percents, which on the flat part
+ * of a Li-ion curve span several millivolts. Whenever a level is recorded,
+ * the voltage of the last fetch of the zmk,battery sensor is read as well, so
+ * no extra wakeup nor conversion is taken, and fed through a median and
+ * moving average filter. The filtered voltage is kept when it moved by
+ * ZMK_BATTERY_HISTORY_MILLIVOLTS_STEP or a level entry is recorded.
+ *
+ * Samples are stored delta-encoded in blocks of BLOCK_SAMPLES under
+ * battery_history_millivolts/bN, N being the block number modulo
+ * ZMK_BATTERY_HISTORY_MILLIVOLTS_BLOCKS. Only the blocks changed since the
+ * last save are written along with it, a full block is never written again.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#ifdef CONFIG_ZMK_BATTERY_SKIP_IF_USB_POWERED
+#include <zmk/usb.h>
+#endif
+
+#include "battery_history_backend.h"
+#include "battery_history_millivolts.h"
+#include "battery_history_stats.h"
+#include "battery_history_voltage.h"
+
+LOG_MODULE_DECLARE(zmk_battery_history, CONFIG_ZMK_LOG_LEVEL);
+
+#if !DT_HAS_CHOSEN(zmk_battery)
+#error "CONFIG_ZMK_BATTERY_HISTORY_MILLIVOLTS requires a zmk,battery chosen node"
+#endif
+
+#define NUM_BLOCKS CONFIG_ZMK_BATTERY_HISTORY_MILLIVOLTS_BLOCKS
+#define BLOCK_SAMPLES 32
+
+BUILD_ASSERT(NUM_BLOCKS <= 32, "dirty blocks are tracked in a 32-bit mask");
+
+struct block_record {
+    uint16_t crc; // CRC16 of the rest of the record
+    uint32_t seq; // Block number, counting from 1
+    uint8_t data[BATTERY_HISTORY_VOLTAGE_MAX_SIZE(BLOCK_SAMPLES)];
+} __packed;
+
+#define BLOCK_RECORD_HEADER_SIZE offsetof(struct block_record, data)
+
+static const struct device *const battery = DEVICE_DT_GET(DT_CHOSEN(zmk_battery));
+
+// Samples by block number modulo NUM_BLOCKS
+static struct zmk_battery_history_voltage_sample samples[NUM_BLOCKS][BLOCK_SAMPLES];
+static uint8_t block_counts[NUM_BLOCKS];
+static uint32_t block_seqs[NUM_BLOCKS];
+
+// Block number of the newest block, 0 before the first sample
+static uint32_t last_seq = 0;
+
+static uint32_t dirty_blocks = 0;
+// Blocks that may have a stored record
+static uint32_t stored_blocks = 0;
+
+static struct battery_history_voltage_filter filter;
+
+// Nothing is recorded before the stored blocks are loaded
+static bool millivolts_loaded = false;
+
+static uint16_t get_block_crc(const struct block_record *record, size_t len) {
+    return crc16_ccitt(0xffff, (const uint8_t *)record + sizeof(record->crc),
+                       len - sizeof(record->crc));
+}
+
+/**
+ * Whether the block is one of the newest NUM_BLOCKS and holds samples
+ */
+static bool is_kept(uint32_t seq) {
+    return seq > 0 && seq <= last_seq && last_seq - seq < NUM_BLOCKS &&
+           block_seqs[seq % NUM_BLOCKS] == seq && block_counts[seq % NUM_BLOCKS] > 0;
+}
+
+static int read_millivolts(void) {
+    struct sensor_value value;
+
+    if (!device_is_ready(battery)) {
+        return -ENODEV;
+    }
+    // The value of the last fetch by the battery reporting, nothing is converted
+    int rc = sensor_channel_get(battery, SENSOR_CHAN_GAUGE_VOLTAGE, &value);
+    if (rc < 0) {
+        return rc;
+    }
+    return value.val1 * 1000 + value.val2 / 1000;
+}
+
+static const struct zmk_battery_history_voltage_sample *get_last_sample(void) {
+    if (!is_kept(last_seq)) {
+        return NULL;
+    }
+    int slot = last_seq % NUM_BLOCKS;
+    return &samples[slot][block_counts[slot] - 1];
+}
+
+static void push_sample(uint32_t timestamp, uint16_t millivolts) {
+    int slot = last_seq % NUM_BLOCKS;
+
+    if (!is_kept(last_seq) || block_counts[slot] >= BLOCK_SAMPLES) {
+        // The oldest block is dropped
+        last_seq++;
+        slot = last_seq % NUM_BLOCKS;
+        block_seqs[slot] = last_seq;
+        block_counts[slot] = 0;
+    }
+    samples[slot][block_counts[slot]++] = (struct zmk_battery_history_voltage_sample){
+        .timestamp = timestamp,
+        .millivolts = millivolts,
+    };
+    dirty_blocks |= BIT(slot);
+}
+
+void battery_history_millivolts_record(uint32_t timestamp, bool entry_added) {
+    if (!millivolts_loaded) {
+        return;
+    }
+#ifdef CONFIG_ZMK_BATTERY_SKIP_IF_USB_POWERED
+    if (zmk_usb_is_powered()) {
+        // The charging voltage says nothing about the drain, start over after
+        battery_history_voltage_filter_init(&filter,
+                                            CONFIG_ZMK_BATTERY_HISTORY_MILLIVOLTS_EMA_SHIFT);
+        return;
+    }
+#endif
+    int rc = read_millivolts();
+    if (rc <= 0 || rc > UINT16_MAX) {
+        LOG_DBG("Failed to read battery voltage: %d", rc);
+        return;
+    }
+
+    uint16_t millivolts = battery_history_voltage_filter_update(&filter, (uint16_t)rc);
+    const struct zmk_battery_history_voltage_sample *last = get_last_sample();
+    if (!entry_added && last) {
+        int moved = abs((int)millivolts - (int)last->millivolts);
+        if (moved < CONFIG_ZMK_BATTERY_HISTORY_MILLIVOLTS_STEP) {
+            return;
+        }
+    }
+    LOG_DBG("Recording battery voltage %u mV, read %d mV", millivolts, rc);
+    push_sample(timestamp, millivolts);
+}
+
+static int save_block(int slot) {
+    struct block_record record;
+    char key[40];
+
+    int rc = battery_history_voltage_encode(samples[slot], block_counts[slot], record.data,
+                                            sizeof(record.data));
+    if (rc < 0) {
+        return rc;
+    }
+    size_t len = BLOCK_RECORD_HEADER_SIZE + rc;
+    record.seq = block_seqs[slot];
+    record.crc = get_block_crc(&record, len);
+
+    snprintf(key, sizeof(key), "battery_history_millivolts/b%d", slot);
+    rc = settings_save_one(key, &record, len);
+    if (rc < 0) {
+        LOG_ERR("Failed to save %s: %d", key, rc);
+        return rc;
+    }
+    battery_history_stats_add_write(1, len);
+    stored_blocks |= BIT(slot);
+    return 0;
+}
+
+int battery_history_millivolts_save(void) {
+    int written = 0;
+
+    for (int slot = 0; slot < NUM_BLOCKS; slot++) {
+        if (!(dirty_blocks & BIT(slot))) {
+            continue;
+        }
+        int rc = save_block(slot);
+        if (rc < 0) {
+            return rc;
+        }
+        dirty_blocks &= ~BIT(slot);
+        written++;
+    }
+    return written;
+}
+
+void battery_history_millivolts_clear(void) {
+    for (int slot = 0; slot < NUM_BLOCKS; slot++) {
+        if (stored_blocks & BIT(slot)) {
+            char key[40];
+            snprintf(key, sizeof(key), "battery_history_millivolts/b%d", slot);
+            settings_delete(key);
+        }
+    }
+    memset(block_counts, 0, sizeof(block_counts));
+    memset(block_seqs, 0, sizeof(block_seqs));
+    last_seq = 0;
+    dirty_blocks = 0;
+    stored_blocks = 0;
+}
+
+int zmk_battery_history_get_voltage_count(void) {
+    int count = 0;
+
+    for (uint32_t age = 0; age < NUM_BLOCKS && age < last_seq; age++) {
+        if (is_kept(last_seq - age)) {
+            count += block_counts[(last_seq - age) % NUM_BLOCKS];
+        }
+    }
+    return count;
+}
+
+int zmk_battery_history_get_voltage_sample(int index,
+                                           struct zmk_battery_history_voltage_sample *sample) {
+    if (index < 0 || !sample) {
+        return -EINVAL;
+    }
+    // Oldest first, skipping blocks lost to corruption
+    for (uint32_t age = MIN(NUM_BLOCKS, last_seq); age-- > 0;) {
+        uint32_t seq = last_seq - age;
+        if (!is_kept(seq)) {
+            continue;
+        }
+        int count = block_counts[seq % NUM_BLOCKS];
+        if (index < count) {
+            *sample = samples[seq % NUM_BLOCKS][index];
+            return 0;
+        }
+        index -= count;
+    }
+    return -EINVAL;
+}
+
+static int millivolts_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+                                   void *cb_arg) {
+    struct block_record record;
+    char *end;
+
+    if (name[0] != 'b') {
+        return -ENOENT;
+    }
+    unsigned long slot = strtoul(name + 1, &end, 10);
+    if (end == name + 1 || *end != '\0') {
+        return -ENOENT;
+    }
+    if (slot >= NUM_BLOCKS) {
+        // Written with more ZMK_BATTERY_HISTORY_MILLIVOLTS_BLOCKS
+        return 0;
+    }
+    stored_blocks |= BIT(slot);
+    if (len <= BLOCK_RECORD_HEADER_SIZE || len > sizeof(record)) {
+        return -EINVAL;
+    }
+    int rc = read_cb(cb_arg, &record, len);
+    if (rc < 0) {
+        return rc;
+    }
+    if (record.crc != get_block_crc(&record, len)) {
+        LOG_WRN("Discarding corrupt battery history voltage block %s", name);
+        battery_history_count_discarded();
+        return 0;
+    }
+    if (slot != record.seq % NUM_BLOCKS) {
+        // Written with another ZMK_BATTERY_HISTORY_MILLIVOLTS_BLOCKS
+        return 0;
+    }
+    rc = battery_history_voltage_decode(record.data, len - BLOCK_RECORD_HEADER_SIZE,
+                                        samples[slot], BLOCK_SAMPLES);
+    if (rc < 0) {
+        LOG_WRN("Discarding undecodable battery history voltage block %s", name);
+        battery_history_count_discarded();
+        return 0;
+    }
+    block_counts[slot] = rc;
+    block_seqs[slot] = record.seq;
+    last_seq = MAX(last_seq, record.seq);
+    return 0;
+}
+
+static int millivolts_settings_commit(void) {
+    battery_history_voltage_filter_init(&filter, CONFIG_ZMK_BATTERY_HISTORY_MILLIVOLTS_EMA_SHIFT);
+    millivolts_loaded = true;
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(battery_history_millivolts, "battery_history_millivolts", NULL,
+                               millivolts_settings_set, millivolts_settings_commit, NULL);
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - filtered millivolt series
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Read the battery voltage and keep it if it moved
+ * Called by the core with every recorded level, so the series takes no
+ * wakeups of its own.
+ * @param timestamp Seconds on the history timeline
+ * @param entry_added Whether a level entry is recorded along with it, which
+ *        always keeps the voltage
+ */
+void battery_history_millivolts_record(uint32_t timestamp, bool entry_added);
+
+/**
+ * @brief Write the blocks changed since the last save
+ * @return Number of settings records written, or negative error code
+ */
+int battery_history_millivolts_save(void);
+
+/**
+ * @brief Drop every sample and delete the stored blocks
+ */
+void battery_history_millivolts_clear(void);
@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - append-only log on a dedicated NVS partition
+ *
+ * Every save appends the new entries as one or more log records. Records use
+ * a fixed range of NVS IDs in rotation, and each record carries the sequence
+ * number of its first entry. The IDs thus hold increasing sequence numbers up
+ * to the newest record, followed by older or missing records, so the newest
+ * record (and therefore the write position) and the oldest record still
+ * needed are found by bisecting the ID range at boot. Only when a corrupt
+ * record is in the way, the whole range is scanned. Records failing their CRC
+ * are skipped and counted. Since NVS itself is log-structured, reusing an ID
+ * after wraparound is still a pure append.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include "battery_history_backend.h"
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_COMPRESSION
+#include "battery_history_codec.h"
+#endif
+
+LOG_MODULE_DECLARE(zmk_battery_history, CONFIG_ZMK_LOG_LEVEL);
+
+// Never storage_partition, whatever backend settings use there
+#if !FIXED_PARTITION_EXISTS(battery_history_partition)
+#error "CONFIG_ZMK_BATTERY_HISTORY_STORAGE_NVS_LOG requires a battery_history_partition"
+#endif
+
+#define LOG_PARTITION battery_history_partition
+
+// Entries packed into a single NVS record
+#define LOG_RECORD_ENTRIES 16
+// Every entry may end up in its own record, so this covers a full history
+#define LOG_RECORD_IDS CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES
+#define LOG_ID_BASE 1
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_COMPRESSION
+#define LOG_PAYLOAD_SIZE BATTERY_HISTORY_CODEC_MAX_SIZE(LOG_RECORD_ENTRIES)
+#else
+#define LOG_PAYLOAD_SIZE (LOG_RECORD_ENTRIES * sizeof(struct zmk_battery_history_entry))
+#endif
+
+struct log_record {
+    uint16_t crc; // CRC16 of the rest of the record
+    uint32_t seq; // Sequence number of the first entry
+    uint8_t payload[LOG_PAYLOAD_SIZE];
+} __packed;
+
+#define LOG_RECORD_HEADER_SIZE offsetof(struct log_record, payload)
+
+static struct nvs_fs fs;
+static bool mounted = false;
+
+// Sequence number of the next entry to append
+static uint32_t next_seq = 0;
+// Position of the next record in the ID range
+static int next_record = 0;
+
+static struct battery_history_backend_stats stats;
+
+static int mount_log(void) {
+    struct flash_pages_info info;
+    int rc;
+
+    fs.flash_device = FIXED_PARTITION_DEVICE(LOG_PARTITION);
+    if (!device_is_ready(fs.flash_device)) {
+        LOG_ERR("Battery history flash device is not ready");
+        return -ENODEV;
+    }
+    fs.offset = FIXED_PARTITION_OFFSET(LOG_PARTITION);
+
+    rc = flash_get_page_info_by_offs(fs.flash_device, fs.offset, &info);
+    if (rc < 0) {
+        LOG_ERR("Failed to get flash page info: %d", rc);
+        return rc;
+    }
+    fs.sector_size = info.size;
+    fs.sector_count = FIXED_PARTITION_SIZE(LOG_PARTITION) / info.size;
+
+    rc = nvs_mount(&fs);
+    if (rc < 0) {
+        LOG_ERR("Failed to mount battery history NVS log: %d", rc);
+        return rc;
+    }
+    mounted = true;
+    LOG_INF("Battery history NVS log mounted");
+    return 0;
+}
+
+static uint16_t get_record_crc(const struct log_record *rec, size_t len) {
+    return crc16_ccitt(0xffff, (const uint8_t *)rec + sizeof(rec->crc), len - sizeof(rec->crc));
+}
+
+/**
+ * Read a record, returning the number of entries it holds
+ * Returns 0 for missing records and -EBADMSG for corrupt ones.
+ */
+static int read_record(int record, uint32_t *seq, struct zmk_battery_history_entry *entries) {
+    struct log_record rec;
+    ssize_t len = nvs_read(&fs, LOG_ID_BASE + record, &rec, sizeof(rec));
+    if (len == -ENOENT) {
+        return 0;
+    }
+    if (len <= (ssize_t)LOG_RECORD_HEADER_SIZE || len > sizeof(rec) ||
+        rec.crc != get_record_crc(&rec, len)) {
+        return -EBADMSG;
+    }
+
+    size_t payload_len = len - LOG_RECORD_HEADER_SIZE;
+    *seq = rec.seq;
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_COMPRESSION
+    int n = battery_history_codec_decode(rec.payload, payload_len, entries, LOG_RECORD_ENTRIES);
+    return n < 0 ? -EBADMSG : n;
+#else
+    if (payload_len % sizeof(struct zmk_battery_history_entry) != 0) {
+        return -EBADMSG;
+    }
+    memcpy(entries, rec.payload, payload_len);
+    return payload_len / sizeof(struct zmk_battery_history_entry);
+#endif
+}
+
+static int nvs_backend_init(void) { return mount_log(); }
+
+/**
+ * Find the newest record by bisecting the ID range, setting next_seq
+ * Returns the record, or a negative error code if record 0 is missing or a
+ * corrupt record is read, the range has to be scanned then.
+ */
+static int bisect_newest_record(void) {
+    struct zmk_battery_history_entry entries[LOG_RECORD_ENTRIES];
+    uint32_t first_seq, seq;
+
+    int n = read_record(0, &first_seq, entries);
+    if (n <= 0) {
+        return n == 0 ? -ENOENT : n;
+    }
+    next_seq = first_seq + n;
+
+    // Record lo is the newest one or comes before it, record hi after it
+    int lo = 0, hi = LOG_RECORD_IDS;
+    while (hi - lo > 1) {
+        int mid = lo + (hi - lo) / 2;
+        n = read_record(mid, &seq, entries);
+        if (n < 0) {
+            return n;
+        }
+        if (n > 0 && seq > first_seq) {
+            lo = mid;
+            next_seq = seq + n;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Find the newest record by reading every ID, setting next_seq
+ * Returns the record, or -ENOENT if the log is empty
+ */
+static int scan_newest_record(void) {
+    struct zmk_battery_history_entry entries[LOG_RECORD_ENTRIES];
+    uint32_t seq;
+    int newest = -ENOENT;
+
+    next_seq = 0;
+    for (int i = 0; i < LOG_RECORD_IDS; i++) {
+        int n = read_record(i, &seq, entries);
+        if (n > 0 && (newest < 0 || seq + n > next_seq)) {
+            newest = i;
+            next_seq = seq + n;
+        }
+    }
+    return newest;
+}
+
+/**
+ * Find the oldest record holding an entry from first_seq on, by bisecting the
+ * records in write order starting at next_record
+ * Returns its offset from next_record, 0 if a corrupt record is read.
+ */
+static int bisect_replay_start(uint32_t first_seq) {
+    struct zmk_battery_history_entry entries[LOG_RECORD_ENTRIES];
+    uint32_t seq;
+
+    // Records up to lo are missing or older, the newest record at the end is not
+    int lo = -1, hi = LOG_RECORD_IDS - 1;
+    while (hi - lo > 1) {
+        int mid = lo + (hi - lo) / 2;
+        int n = read_record((next_record + mid) % LOG_RECORD_IDS, &seq, entries);
+        if (n < 0) {
+            return 0;
+        }
+        if (n == 0 || seq + n <= first_seq) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return hi;
+}
+
+/**
+ * Replay the log into the ring
+ */
+static int nvs_backend_load(void) {
+    struct zmk_battery_history_entry entries[LOG_RECORD_ENTRIES];
+    uint32_t seq;
+
+    if (!mounted) {
+        return -ENODEV;
+    }
+
+    // Find the newest record, the write position follows it
+    int newest = bisect_newest_record();
+    if (newest < 0) {
+        newest = scan_newest_record();
+    }
+    if (newest < 0) {
+        return 0;
+    }
+    next_record = (newest + 1) % LOG_RECORD_IDS;
+
+    // Replay up to the newest record, skipping entries beyond one full history
+    uint32_t first_seq =
+        next_seq > CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES
+            ? next_seq - CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES
+            : 0;
+    for (int i = bisect_replay_start(first_seq); i < LOG_RECORD_IDS; i++) {
+        int record = (next_record + i) % LOG_RECORD_IDS;
+        int n = read_record(record, &seq, entries);
+        if (n == -EBADMSG) {
+            LOG_WRN("Discarding corrupt battery history record %d", record);
+            battery_history_count_discarded();
+        }
+        for (int j = 0; j < n; j++) {
+            if (seq + j >= first_seq && seq + j < next_seq) {
+                battery_history_restore_entry(&entries[j]);
+            }
+        }
+    }
+
+    LOG_DBG("Battery history NVS log: next_seq=%u, next_record=%d", next_seq, next_record);
+    return 0;
+}
+
+static int nvs_backend_append(int index, const struct zmk_battery_history_entry *entries,
+                              int count) {
+    struct log_record rec;
+    int written = 0;
+
+    if (!mounted) {
+        return -ENODEV;
+    }
+
+    while (count > 0) {
+        int n = MIN(count, LOG_RECORD_ENTRIES);
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_COMPRESSION
+        int payload_len = battery_history_codec_encode(entries, n, rec.payload, LOG_PAYLOAD_SIZE);
+        if (payload_len < 0) {
+            return payload_len;
+        }
+#else
+        int payload_len = n * sizeof(struct zmk_battery_history_entry);
+        memcpy(rec.payload, entries, payload_len);
+#endif
+        size_t len = LOG_RECORD_HEADER_SIZE + payload_len;
+
+        rec.seq = next_seq;
+        rec.crc = get_record_crc(&rec, len);
+
+        ssize_t rc = nvs_write(&fs, LOG_ID_BASE + next_record, &rec, len);
+        if (rc < 0) {
+            LOG_ERR("Failed to append battery history record %d: %d", next_record, (int)rc);
+            return rc;
+        }
+
+        stats.records_written++;
+        stats.bytes_written += len;
+        next_seq += n;
+        next_record = (next_record + 1) % LOG_RECORD_IDS;
+        entries += n;
+        count -= n;
+        written++;
+    }
+    return written;
+}
+
+static int nvs_backend_clear(void) {
+    if (!mounted) {
+        return -ENODEV;
+    }
+
+    int rc = nvs_clear(&fs);
+    mounted = false;
+    if (rc < 0) {
+        LOG_ERR("Failed to clear battery history NVS log: %d", rc);
+        return rc;
+    }
+    next_seq = 0;
+    next_record = 0;
+    return mount_log();
+}
+
+static void nvs_backend_get_stats(struct battery_history_backend_stats *out) { *out = stats; }
+
+const struct battery_history_backend battery_history_backend = {
+    .name = "nvs",
+    .init = nvs_backend_init,
+    .load = nvs_backend_load,
+    .append = nvs_backend_append,
+    .clear = nvs_backend_clear,
+    .get_stats = nvs_backend_get_stats,
+};
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - RAM-only backend
+ *
+ * Nothing is persisted: the history lives in the RAM ring only and is lost
+ * on reset. Saves still go through the backend interface and are counted,
+ * so the recording policy can be tested and benchmarked without flash.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "battery_history_backend.h"
+
+LOG_MODULE_DECLARE(zmk_battery_history, CONFIG_ZMK_LOG_LEVEL);
+
+static struct battery_history_backend_stats stats;
+
+static int ram_backend_load(void) { return 0; }
+
+static int ram_backend_append(int index, const struct zmk_battery_history_entry *entries,
+                              int count) {
+    stats.records_written += count;
+    stats.bytes_written += count * sizeof(*entries);
+    return count;
+}
+
+static int ram_backend_clear(void) { return 0; }
+
+static void ram_backend_get_stats(struct battery_history_backend_stats *out) { *out = stats; }
+
+const struct battery_history_backend battery_history_backend = {
+    .name = "ram",
+    .load = ram_backend_load,
+    .append = ram_backend_append,
+    .clear = ram_backend_clear,
+    .get_stats = ram_backend_get_stats,
+};
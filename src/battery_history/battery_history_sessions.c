@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - boot sessions
+ *
+ * Every boot starts a session, kept as a single record under
+ * battery_history_sessions/sN, N being the boot number modulo
+ * ZMK_BATTERY_HISTORY_SESSION_COUNT. Records are ordered by their boot
+ * number, so the oldest one is simply overwritten and no index is stored. The
+ * record of the current session is written when it starts and rewritten when
+ * it ends before sleep. In between, its uptime and battery level are only
+ * kept current in RAM for the history requests.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/crc.h>
+
+#ifdef CONFIG_HWINFO
+#include <zephyr/drivers/hwinfo.h>
+#endif
+
+#include "battery_history_epoch.h"
+#include "battery_history_sessions.h"
+#include "battery_history_stats.h"
+
+LOG_MODULE_DECLARE(zmk_battery_history, CONFIG_ZMK_LOG_LEVEL);
+
+#define SESSION_COUNT CONFIG_ZMK_BATTERY_HISTORY_SESSION_COUNT
+
+struct session_record {
+    uint16_t crc; // CRC16 of the session
+    struct zmk_battery_history_session session;
+} __packed;
+
+// Sessions by boot number modulo SESSION_COUNT, boot 0 marks an empty slot
+static struct zmk_battery_history_session sessions[SESSION_COUNT];
+
+// Boot number of the newest session
+static uint32_t last_boot = 0;
+
+static bool sessions_loaded = false;
+static bool session_started = false;
+
+static uint16_t get_session_crc(const struct zmk_battery_history_session *session) {
+    return crc16_ccitt(0xffff, (const uint8_t *)session, sizeof(*session));
+}
+
+/**
+ * Whether the slot holds one of the newest SESSION_COUNT sessions
+ */
+static bool is_kept(uint32_t boot) {
+    return boot > 0 && boot <= last_boot && last_boot - boot < SESSION_COUNT &&
+           sessions[boot % SESSION_COUNT].boot == boot;
+}
+
+static uint8_t get_boot_reason(void) {
+#ifdef CONFIG_HWINFO
+    uint32_t cause = 0;
+
+    if (hwinfo_get_reset_cause(&cause) < 0) {
+        return ZMK_BATTERY_HISTORY_BOOT_REASON_UNKNOWN;
+    }
+    // The flags accumulate until cleared
+    hwinfo_clear_reset_cause();
+
+    if (cause & RESET_LOW_POWER_WAKE) {
+        return ZMK_BATTERY_HISTORY_BOOT_REASON_SLEEP_WAKE;
+    }
+    if (cause & RESET_WATCHDOG) {
+        return ZMK_BATTERY_HISTORY_BOOT_REASON_WATCHDOG;
+    }
+    if (cause & RESET_BROWNOUT) {
+        return ZMK_BATTERY_HISTORY_BOOT_REASON_BROWNOUT;
+    }
+    if (cause & RESET_SOFTWARE) {
+        return ZMK_BATTERY_HISTORY_BOOT_REASON_SOFTWARE;
+    }
+    if (cause & RESET_PIN) {
+        return ZMK_BATTERY_HISTORY_BOOT_REASON_PIN;
+    }
+    if (cause & RESET_POR || cause == 0) {
+        // Some SoCs flag no cause at all after power-on
+        return ZMK_BATTERY_HISTORY_BOOT_REASON_POWER_ON;
+    }
+    return ZMK_BATTERY_HISTORY_BOOT_REASON_OTHER;
+#else
+    return ZMK_BATTERY_HISTORY_BOOT_REASON_UNKNOWN;
+#endif
+}
+
+static int save_session(const struct zmk_battery_history_session *session) {
+    struct session_record record = {.session = *session};
+    char key[32];
+
+    // The next session has to start after this one
+    int rc = battery_history_epoch_reserve();
+    if (rc < 0) {
+        return rc;
+    }
+    record.crc = get_session_crc(&record.session);
+    snprintf(key, sizeof(key), "battery_history_sessions/s%u",
+             (unsigned)(session->boot % SESSION_COUNT));
+
+    rc = settings_save_one(key, &record, sizeof(record));
+    if (rc < 0) {
+        LOG_ERR("Failed to save battery history session: %d", rc);
+        return rc;
+    }
+    battery_history_stats_add_write(1, sizeof(record));
+    return 0;
+}
+
+int battery_history_sessions_start(uint8_t level) {
+    if (!sessions_loaded) {
+        return -EAGAIN;
+    }
+    if (session_started) {
+        return 0;
+    }
+
+    const struct zmk_battery_history_session *previous =
+        is_kept(last_boot) ? &sessions[last_boot % SESSION_COUNT] : NULL;
+    struct zmk_battery_history_session *session = &sessions[(last_boot + 1) % SESSION_COUNT];
+
+    *session = (struct zmk_battery_history_session){
+        .start = battery_history_epoch_boot(),
+        .uptime = (uint32_t)(k_uptime_get() / 1000),
+        .prior_uptime = previous ? previous->prior_uptime + previous->uptime : 0,
+        .boot = last_boot + 1,
+        .reason = get_boot_reason(),
+        .last_level = level,
+    };
+    last_boot = session->boot;
+    session_started = true;
+    LOG_INF("Battery history session %u started, reason %d", session->boot, session->reason);
+    return save_session(session);
+}
+
+void battery_history_sessions_update(uint8_t level) {
+    if (!session_started) {
+        return;
+    }
+
+    struct zmk_battery_history_session *session = &sessions[last_boot % SESSION_COUNT];
+
+    session->uptime = (uint32_t)(k_uptime_get() / 1000);
+    session->last_level = level;
+}
+
+int battery_history_sessions_end(uint8_t level) {
+    if (!session_started) {
+        return 0;
+    }
+    battery_history_sessions_update(level);
+    return save_session(&sessions[last_boot % SESSION_COUNT]);
+}
+
+int zmk_battery_history_get_session_count(void) {
+    int count = 0;
+
+    for (uint32_t age = 0; age < SESSION_COUNT && age < last_boot; age++) {
+        count += is_kept(last_boot - age);
+    }
+    return count;
+}
+
+int zmk_battery_history_get_session(int index, struct zmk_battery_history_session *session) {
+    if (index < 0 || !session) {
+        return -EINVAL;
+    }
+    // Oldest first, skipping slots lost to corruption
+    for (uint32_t age = MIN(SESSION_COUNT, last_boot); age-- > 0;) {
+        if (is_kept(last_boot - age) && index-- == 0) {
+            *session = sessions[(last_boot - age) % SESSION_COUNT];
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+static int sessions_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+                                 void *cb_arg) {
+    struct session_record record;
+    char *end;
+
+    if (name[0] != 's') {
+        return -ENOENT;
+    }
+    unsigned long slot = strtoul(name + 1, &end, 10);
+    if (end == name + 1 || *end != '\0') {
+        return -ENOENT;
+    }
+    if (len != sizeof(record)) {
+        return -EINVAL;
+    }
+    int rc = read_cb(cb_arg, &record, sizeof(record));
+    if (rc < 0) {
+        return rc;
+    }
+    if (record.crc != get_session_crc(&record.session) || record.session.boot == 0) {
+        LOG_WRN("Discarding corrupt battery history session %s", name);
+        return 0;
+    }
+    if (slot != record.session.boot % SESSION_COUNT) {
+        // Written with another ZMK_BATTERY_HISTORY_SESSION_COUNT
+        return 0;
+    }
+    sessions[slot] = record.session;
+    last_boot = MAX(last_boot, record.session.boot);
+    return 0;
+}
+
+static int sessions_settings_commit(void) {
+    sessions_loaded = true;
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(battery_history_sessions, "battery_history_sessions", NULL,
+                               sessions_settings_set, sessions_settings_commit, NULL);
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - boot sessions
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Start the session of the current boot and write its record
+ * Called by the core with every recorded level, only the first call after
+ * the settings are loaded starts the session.
+ * @param level Battery level at the start of the session
+ * @return 0 on success, -EAGAIN before the stored sessions were loaded, or
+ *         negative error code
+ */
+int battery_history_sessions_start(uint8_t level);
+
+/**
+ * @brief Set the uptime and battery level of the current session in RAM,
+ * called along with saves, nothing is written
+ */
+void battery_history_sessions_update(uint8_t level);
+
+/**
+ * @brief Rewrite the record of the current session with its uptime and the
+ * given battery level, called before sleep
+ * @return 0 on success, negative error code on failure
+ */
+int battery_history_sessions_end(uint8_t level);
@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - settings backend with one record per entry
+ *
+ * Every ring slot is stored under its own battery_history/eN key, and the
+ * ring position in an A/B header (h0/h1) committed after the entries. With
+ * ZMK_BATTERY_HISTORY_LAZY_LOAD only the header is read during the global
+ * settings load, then the newest entry at commit, and the other entries are
+ * loaded directly once first needed.
+ *
+ * Records of releases before the timeline hold per-boot 16-bit timestamps.
+ * They are rebased onto the timeline while loading, so the rest of the
+ * history only ever sees timeline timestamps, and rewritten in the background.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include "battery_history_backend.h"
+#include "battery_history_epoch.h"
+#include "battery_history_settings.h"
+#include "battery_history_timeline.h"
+
+LOG_MODULE_DECLARE(zmk_battery_history, CONFIG_ZMK_LOG_LEVEL);
+
+#define MAX_ENTRIES CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES
+
+// Generation of the newest header in storage (0 = none)
+static uint32_t header_generation = 0;
+// Ring position described by the newest header read while loading
+static int loaded_head = 0;
+static int loaded_count = 0;
+
+// head/count keys written before the header was introduced
+static int legacy_head = -1;
+static int legacy_count = -1;
+
+// Entry records of older versions were loaded, or the legacy head/count were used
+static bool legacy_records = false;
+
+// Buffer slots whose stored entry was discarded while loading
+static ATOMIC_DEFINE(corrupt_entries, MAX_ENTRIES);
+
+// Buffer slots whose stored entry has a per-boot timestamp
+static ATOMIC_DEFINE(legacy_entries, MAX_ENTRIES);
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_LAZY_LOAD
+// Entries were loaded at commit already, to rebase them
+static bool entries_loaded = false;
+#endif
+
+static struct battery_history_backend_stats stats;
+
+// Time spent in the settings handler while loading
+static uint32_t load_cycles = 0;
+
+/**
+ * CRC16 of a storage record, skipping its leading CRC field
+ */
+static uint16_t get_record_crc(const void *record, size_t len) {
+    return crc16_ccitt(0xffff, (const uint8_t *)record + sizeof(uint16_t),
+                       len - sizeof(uint16_t));
+}
+
+/**
+ * Write a single record of the battery_history subtree straight to storage
+ */
+static int save_record(const char *key, const void *value, size_t len) {
+    int rc = settings_save_one(key, value, len);
+    if (rc < 0) {
+        LOG_ERR("Failed to save %s: %d", key, rc);
+        return rc;
+    }
+    stats.records_written++;
+    stats.bytes_written += len;
+    return 0;
+}
+
+/**
+ * Save a single entry
+ */
+static int save_single_entry(int slot, const struct zmk_battery_history_entry *entry) {
+    struct entry_record record = {
+        .entry = *entry,
+        .crc = crc8_ccitt(0xff, entry, sizeof(*entry)),
+    };
+    char key[32];
+    snprintf(key, sizeof(key), "battery_history/e%d", slot);
+
+    return save_record(key, &record, sizeof(record));
+}
+
+/**
+ * Commit a new header to the slot not holding the current one
+ */
+static int save_header(void) {
+    struct history_header header = {
+        .generation = header_generation + 1,
+        .head = battery_history_ring_head(),
+        .count = battery_history_ring_count(),
+        .version = HEADER_FORMAT_VERSION,
+    };
+    header.crc = get_record_crc(&header, sizeof(header));
+    char key[32];
+    snprintf(key, sizeof(key), "battery_history/h%u", (unsigned int)(header.generation & 1));
+
+    int rc = save_record(key, &header, sizeof(header));
+    if (rc < 0) {
+        return rc;
+    }
+    header_generation = header.generation;
+    return 0;
+}
+
+static int settings_backend_load(void) {
+    // Loaded by the settings subsystem, see the commit handler
+    return -EINPROGRESS;
+}
+
+static int settings_backend_append(int index, const struct zmk_battery_history_entry *entries,
+                                   int count) {
+    int slot = (battery_history_ring_head() + index) % MAX_ENTRIES;
+
+    LOG_DBG("Incremental save: %d entries starting from idx %d", count, slot);
+
+    for (int i = 0; i < count; i++) {
+        int rc = save_single_entry(slot, &entries[i]);
+        if (rc < 0) {
+            return rc;
+        }
+        slot = (slot + 1) % MAX_ENTRIES;
+    }
+    return count;
+}
+
+static int settings_backend_flush(void) {
+    // Commit head/count only once the entries they describe are stored
+    int rc = save_header();
+    return rc < 0 ? rc : 1;
+}
+
+static int settings_backend_clear(void) {
+    // Entries beyond the committed count are ignored, the header is enough
+    return save_header();
+}
+
+static void settings_backend_get_stats(struct battery_history_backend_stats *out) { *out = stats; }
+
+/**
+ * Load a single entry record of any version, checking its CRC
+ */
+static int load_entry(int idx, size_t len, settings_read_cb read_cb, void *cb_arg) {
+    uint8_t buf[sizeof(struct entry_record)];
+    struct zmk_battery_history_entry entry;
+    bool legacy;
+
+    if (len > sizeof(buf)) {
+        return -EINVAL;
+    }
+    int rc = read_cb(cb_arg, buf, len);
+    if (rc < 0) {
+        return rc;
+    }
+
+    if (decode_entry_record(buf, len, &entry, &legacy) < 0) {
+        LOG_WRN("Discarding corrupt battery history entry %d", idx);
+        battery_history_count_discarded();
+        atomic_set_bit(corrupt_entries, idx);
+        return 0;
+    }
+
+    battery_history_restore_slot(idx, &entry);
+    atomic_clear_bit(corrupt_entries, idx);
+    atomic_set_bit_to(legacy_entries, idx, legacy);
+    return 0;
+}
+
+/**
+ * Whether a ring slot holds an entry with a per-boot timestamp
+ */
+static bool has_legacy_entries(int head, int count) {
+    for (int i = 0; i < count; i++) {
+        if (atomic_test_bit(legacy_entries, (head + i) % MAX_ENTRIES)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Move the restored entries with per-boot timestamps onto the timeline, oldest
+ * first, and start the current boot after them
+ */
+static void rebase_entries(int head, int count) {
+    struct battery_history_rebase rebase;
+
+    battery_history_rebase_init(&rebase);
+    for (int i = 0; i < count; i++) {
+        int slot = (head + i) % MAX_ENTRIES;
+        struct zmk_battery_history_entry entry;
+
+        battery_history_ring_read_slot(slot, &entry);
+        if (atomic_test_and_clear_bit(legacy_entries, slot)) {
+            entry.timestamp = battery_history_rebase_legacy(&rebase, entry.timestamp);
+        } else {
+            entry.timestamp = battery_history_rebase_current(&rebase, entry.timestamp);
+        }
+        battery_history_restore_slot(slot, &entry);
+    }
+    if (count > 0) {
+        battery_history_epoch_advance(battery_history_rebase_last(&rebase));
+    }
+    LOG_INF("Moved %d battery history entries onto the timeline", count);
+}
+
+/**
+ * Number of oldest entries to drop, so the history older than the newest
+ * discarded entry does not leave a gap
+ */
+static int count_corrupt_prefix(int head, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+        if (atomic_test_bit(corrupt_entries, (head + i) % MAX_ENTRIES)) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Rewrite the records of older formats and delete the legacy head/count keys,
+ * so later boots only see the current format
+ */
+static void migrate_work_handler(struct k_work *work) {
+    if (legacy_records) {
+        int rc = battery_history_rewrite();
+        if (rc < 0) {
+            LOG_ERR("Failed to migrate battery history: %d", rc);
+            return;
+        }
+        legacy_records = false;
+        LOG_INF("Battery history migrated to format version %d", HEADER_FORMAT_VERSION);
+    }
+    if (legacy_head >= 0 || legacy_count >= 0) {
+        // Superseded by the header
+        settings_delete("battery_history/head");
+        settings_delete("battery_history/count");
+        legacy_head = -1;
+        legacy_count = -1;
+    }
+}
+
+K_WORK_DEFINE(migrate_work, migrate_work_handler);
+
+/**
+ * Run the migration in the background if loading found legacy records
+ */
+static void schedule_migration(void) {
+    if (legacy_records || legacy_head >= 0 || legacy_count >= 0) {
+        // On the queue of every other ring access, never concurrently with them
+        k_work_submit(&migrate_work);
+    }
+}
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_LAZY_LOAD
+struct load_entries_range {
+    int head;
+    int count;
+};
+
+static int load_entries_cb(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg,
+                           void *param) {
+    const struct load_entries_range *range = param;
+
+    if (key[0] != 'e') {
+        return 0;
+    }
+    int idx = atoi(key + 1);
+    // Slots past the requested range hold entries recorded since boot
+    if (idx < 0 || idx >= MAX_ENTRIES ||
+        (idx - range->head + MAX_ENTRIES) % MAX_ENTRIES >= range->count) {
+        return 0;
+    }
+    return load_entry(idx, len, read_cb, cb_arg);
+}
+
+static int settings_backend_load_entries(int count) {
+    if (entries_loaded) {
+        // Loaded and rebased at commit, storage still holds per-boot timestamps
+        return 0;
+    }
+
+    struct load_entries_range range = {
+        .head = battery_history_ring_head(),
+        .count = count,
+    };
+    uint32_t start = k_cycle_get_32();
+
+    int rc = settings_load_subtree_direct("battery_history", load_entries_cb, &range);
+    if (rc < 0) {
+        LOG_ERR("Failed to load battery history entries: %d", rc);
+        return rc;
+    }
+
+    LOG_INF("Battery history entries loaded in %u us",
+            k_cyc_to_us_floor32(k_cycle_get_32() - start));
+    schedule_migration();
+    return count_corrupt_prefix(range.head, count);
+}
+#endif
+
+static int settings_load_one(const char *name, size_t len, settings_read_cb read_cb,
+                             void *cb_arg) {
+    // A/B header with "h0"/"h1" keys, the newest valid one wins
+    if (!strcmp(name, "h0") || !strcmp(name, "h1")) {
+        struct history_header header;
+        if (len != sizeof(header)) {
+            return -EINVAL;
+        }
+        int rc = read_cb(cb_arg, &header, sizeof(header));
+        if (rc < 0) {
+            return rc;
+        }
+        if (header.crc != get_record_crc(&header, sizeof(header)) ||
+            header.version != HEADER_FORMAT_VERSION || header.head >= MAX_ENTRIES ||
+            header.count > MAX_ENTRIES) {
+            LOG_WRN("Discarding corrupt battery history header %s", name);
+            battery_history_count_discarded();
+            return 0;
+        }
+        if (header.generation > header_generation) {
+            header_generation = header.generation;
+            loaded_head = header.head;
+            loaded_count = header.count;
+        }
+        return 0;
+    }
+
+    // head/count keys written by older versions, used when there is no header
+    if (!strcmp(name, "head")) {
+        if (len != sizeof(legacy_head)) {
+            return -EINVAL;
+        }
+        return read_cb(cb_arg, &legacy_head, sizeof(legacy_head));
+    }
+
+    if (!strcmp(name, "count")) {
+        if (len != sizeof(legacy_count)) {
+            return -EINVAL;
+        }
+        return read_cb(cb_arg, &legacy_count, sizeof(legacy_count));
+    }
+
+    // individual entries with "eN" keys
+    if (name[0] == 'e') {
+        int idx = atoi(name + 1);
+        if (idx < 0 || idx >= MAX_ENTRIES) {
+            return -ENOENT;
+        }
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_LAZY_LOAD
+        // Left in storage until first needed, see settings_backend_load_entries(),
+        // unless it has to be rebased at commit
+        atomic_set_bit_to(legacy_entries, idx, len != sizeof(struct entry_record));
+        return 0;
+#else
+        return load_entry(idx, len, read_cb, cb_arg);
+#endif
+    }
+
+    return -ENOENT;
+}
+
+/**
+ * Settings load handler
+ */
+static int battery_history_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+                                        void *cb_arg) {
+    uint32_t start = k_cycle_get_32();
+    int rc = settings_load_one(name, len, read_cb, cb_arg);
+
+    load_cycles += k_cycle_get_32() - start;
+    return rc;
+}
+
+/**
+ * Settings commit handler - called after all settings are loaded
+ */
+static int battery_history_settings_commit(void) {
+    if (header_generation == 0 && legacy_head >= 0 && legacy_head < MAX_ENTRIES &&
+        legacy_count >= 0 && legacy_count <= MAX_ENTRIES) {
+        LOG_INF("Using legacy battery history head/count");
+        loaded_head = legacy_head;
+        loaded_count = legacy_count;
+        legacy_records = true;
+    }
+    bool rebase = has_legacy_entries(loaded_head, loaded_count);
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_LAZY_LOAD
+    if (rebase) {
+        // Rebasing needs every entry, load them now on this single boot
+        struct load_entries_range range = {.head = loaded_head, .count = loaded_count};
+
+        settings_load_subtree_direct("battery_history", load_entries_cb, &range);
+        entries_loaded = true;
+    } else if (loaded_count > 0) {
+        // The newest entry decides what is recorded and saved next
+        struct load_entries_range range = {
+            .head = (loaded_head + loaded_count - 1) % MAX_ENTRIES,
+            .count = 1,
+        };
+
+        settings_load_subtree_direct("battery_history", load_entries_cb, &range);
+    }
+#endif
+    int dropped = count_corrupt_prefix(loaded_head, loaded_count);
+    loaded_head = (loaded_head + dropped) % MAX_ENTRIES;
+    loaded_count -= dropped;
+    if (rebase) {
+        rebase_entries(loaded_head, loaded_count);
+        legacy_records = true;
+    }
+
+    LOG_INF("Battery history settings loaded in %u us", k_cyc_to_us_floor32(load_cycles));
+    battery_history_restore_ring(loaded_head, loaded_count);
+    battery_history_restore_done();
+    schedule_migration();
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(battery_history, "battery_history", NULL,
+                               battery_history_settings_set, battery_history_settings_commit, NULL);
+
+const struct battery_history_backend battery_history_backend = {
+    .name = "settings",
+    .load = settings_backend_load,
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_LAZY_LOAD
+    .load_entries = settings_backend_load_entries,
+#endif
+    .append = settings_backend_append,
+    .flush = settings_backend_flush,
+    .clear = settings_backend_clear,
+    .get_stats = settings_backend_get_stats,
+};
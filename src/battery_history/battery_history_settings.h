@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - records of the per-entry settings layout
+ *
+ * Shared by the per-entry backend and the migration of these records into
+ * the other layouts.
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/toolchain.h>
+#include <zmk/battery_history/battery_history.h>
+
+// Version of the entry format described by the header
+#define HEADER_FORMAT_VERSION 1
+
+/**
+ * Header describing the stored ring buffer, committed after the entry data.
+ * Two copies (h0/h1) are written alternately, so a torn write always leaves
+ * the previous header intact and the newest valid one is picked at load.
+ */
+struct history_header {
+    uint16_t crc;        // CRC16 of the rest of the header
+    uint32_t generation; // Incremented on every commit
+    uint16_t head;
+    uint16_t count;
+    uint8_t version;
+} __packed;
+
+/**
+ * A single entry record, protected by a CRC8 of the entry
+ */
+struct entry_record {
+    struct zmk_battery_history_entry entry;
+    uint8_t crc;
+} __packed;
+
+/**
+ * Entry of releases before the timeline, timestamped in seconds since boot
+ * and stored bare, without a CRC
+ */
+struct legacy_entry {
+    uint16_t timestamp;
+    uint8_t battery_level;
+} __packed;
+
+/**
+ * Decode an entry record of any version, read into a buffer of at least
+ * sizeof(struct entry_record) bytes
+ * @param legacy Set if the timestamp is a per-boot one, still to be rebased
+ * @return 0 on success, -EINVAL if the record is corrupt or of unknown size
+ */
+static inline int decode_entry_record(const void *buf, size_t len,
+                                      struct zmk_battery_history_entry *entry, bool *legacy) {
+    if (len == sizeof(struct entry_record)) {
+        struct entry_record record;
+
+        memcpy(&record, buf, sizeof(record));
+        if (record.crc != crc8_ccitt(0xff, &record.entry, sizeof(record.entry))) {
+            return -EINVAL;
+        }
+        *entry = record.entry;
+        *legacy = false;
+        return 0;
+    }
+
+    struct legacy_entry legacy_entry;
+
+    // Accepted without a CRC if the level is sane
+    if (len != sizeof(legacy_entry)) {
+        return -EINVAL;
+    }
+    memcpy(&legacy_entry, buf, sizeof(legacy_entry));
+    if (legacy_entry.battery_level > 100) {
+        return -EINVAL;
+    }
+    entry->timestamp = legacy_entry.timestamp;
+    entry->battery_level = legacy_entry.battery_level;
+    *legacy = true;
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - pre-sleep record
+ *
+ * Saving through the backend before sleep can take several records, a block
+ * rewrite or a file append, and it runs while the sleep transition waits.
+ * Instead the unsaved entries are written as a single record of fixed size
+ * under battery_history_sleep/r, which is a single append to the settings
+ * storage. After waking up, usually a reboot, the entries are appended to the
+ * restored ring and handed to the backend from the system work queue, like
+ * every other save, then the record is deleted. In the low-battery emergency
+ * mode the record is written after every new entry, and deleted by the next
+ * full save. Being a settings write, the record may still trigger an NVS
+ * garbage collection.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include "battery_history_backend.h"
+#include "battery_history_sleep.h"
+#include "battery_history_stats.h"
+
+LOG_MODULE_DECLARE(zmk_battery_history, CONFIG_ZMK_LOG_LEVEL);
+
+#define SLEEP_RECORD_ENTRIES CONFIG_ZMK_BATTERY_HISTORY_SLEEP_RECORD_ENTRIES
+#define SLEEP_RECORD_KEY "battery_history_sleep/r"
+
+// Retry delay when handing the entries to the backend failed
+#define COMPACT_RETRY_MS (60 * 1000)
+
+/**
+ * Always written in full, so writing it costs the same every time
+ */
+struct sleep_record {
+    uint16_t crc;  // CRC16 of the rest of the record
+    uint8_t count; // Number of valid entries
+    struct zmk_battery_history_entry entries[SLEEP_RECORD_ENTRIES];
+} __packed;
+
+// Stored record, until its entries are appended to the ring
+static struct sleep_record stored_record;
+
+// Whether the settings are loaded and the ring is restored
+static bool record_loaded = false;
+static bool ring_restored = false;
+static bool entries_restored = false;
+
+// Whether a record is stored whose entries the backend may not have yet
+static bool record_pending = false;
+
+static void compact_work_handler(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(compact_work, compact_work_handler);
+
+static uint16_t get_record_crc(const struct sleep_record *record) {
+    return crc16_ccitt(0xffff, (const uint8_t *)record + sizeof(uint16_t),
+                       sizeof(*record) - sizeof(uint16_t));
+}
+
+/**
+ * Hand the entries of the record to the backend, then delete it
+ */
+static void compact_work_handler(struct k_work *work) {
+    int rc = battery_history_save_now();
+    if (rc < 0) {
+        LOG_WRN("Failed to save battery history after sleep: %d", rc);
+        k_work_schedule(&compact_work, K_MSEC(COMPACT_RETRY_MS));
+        return;
+    }
+    battery_history_sleep_clear();
+}
+
+/**
+ * Append the stored entries once both the record and the ring are restored
+ */
+static void restore_entries(void) {
+    if (!record_loaded || !ring_restored || entries_restored) {
+        return;
+    }
+    entries_restored = true;
+    if (stored_record.count > 0) {
+        LOG_INF("Restoring %d battery history entries written before sleep",
+                stored_record.count);
+        for (int i = 0; i < stored_record.count; i++) {
+            battery_history_add_entry(&stored_record.entries[i]);
+        }
+        stored_record.count = 0;
+    }
+    if (record_pending) {
+        k_work_schedule(&compact_work, K_NO_WAIT);
+    }
+    battery_history_start_recording();
+}
+
+int battery_history_sleep_save(const struct zmk_battery_history_entry *entries, int count) {
+    struct sleep_record record = {0};
+
+    if (!entries_restored) {
+        // The stored record was not read yet, do not overwrite it
+        return -EAGAIN;
+    }
+    if (count > SLEEP_RECORD_ENTRIES) {
+        return -ENOSPC;
+    }
+    record.count = count;
+    memcpy(record.entries, entries, count * sizeof(entries[0]));
+    record.crc = get_record_crc(&record);
+
+    int rc = settings_save_one(SLEEP_RECORD_KEY, &record, sizeof(record));
+    if (rc < 0) {
+        LOG_ERR("Failed to save battery history sleep record: %d", rc);
+        return rc;
+    }
+    battery_history_stats_add_write(1, sizeof(record));
+    record_pending = true;
+    return 0;
+}
+
+void battery_history_sleep_restore(void) {
+    ring_restored = true;
+    restore_entries();
+}
+
+bool battery_history_sleep_restored(void) { return entries_restored; }
+
+void battery_history_sleep_wake(void) {
+    if (record_pending) {
+        k_work_schedule(&compact_work, K_NO_WAIT);
+    }
+}
+
+void battery_history_sleep_clear(void) {
+    if (!record_pending) {
+        return;
+    }
+    int rc = settings_delete(SLEEP_RECORD_KEY);
+    if (rc < 0) {
+        LOG_WRN("Failed to delete battery history sleep record: %d", rc);
+        return;
+    }
+    record_pending = false;
+}
+
+static int sleep_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+                              void *cb_arg) {
+    struct sleep_record record;
+
+    if (strcmp(name, "r")) {
+        return -ENOENT;
+    }
+    // Whatever it holds, the record is deleted once the ring is saved
+    record_pending = true;
+    if (len != sizeof(record)) {
+        // Written by a build with another record size
+        LOG_WRN("Ignoring battery history sleep record of %d bytes", (int)len);
+        return 0;
+    }
+    int rc = read_cb(cb_arg, &record, sizeof(record));
+    if (rc < 0) {
+        return rc;
+    }
+    if (record.crc != get_record_crc(&record) || record.count > SLEEP_RECORD_ENTRIES) {
+        LOG_WRN("Discarding corrupt battery history sleep record");
+        battery_history_count_discarded();
+        return 0;
+    }
+    stored_record = record;
+    return 0;
+}
+
+static int sleep_settings_commit(void) {
+    record_loaded = true;
+    restore_entries();
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(battery_history_sleep, "battery_history_sleep", NULL,
+                               sleep_settings_set, sleep_settings_commit, NULL);
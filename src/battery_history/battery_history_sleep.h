@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - pre-sleep record
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include <zmk/battery_history/battery_history.h>
+
+/**
+ * @brief Write the unsaved entries as the single fixed-size sleep record
+ * The entries stay unsaved, they are handed to the backend after waking up.
+ * @param entries Unsaved entries, oldest first
+ * @param count Number of entries, at most
+ *              CONFIG_ZMK_BATTERY_HISTORY_SLEEP_RECORD_ENTRIES
+ * @return 0 on success, -EAGAIN before the stored record was restored, or
+ *         negative error code
+ */
+int battery_history_sleep_save(const struct zmk_battery_history_entry *entries, int count);
+
+/**
+ * @brief Append the entries of the stored sleep record once the ring is
+ * restored, called by the core from battery_history_restore_done()
+ */
+void battery_history_sleep_restore(void);
+
+/**
+ * @brief Whether the entries of the stored sleep record were appended
+ * Nothing is recorded before, so they stay in order.
+ */
+bool battery_history_sleep_restored(void);
+
+/**
+ * @brief Hand the entries of a sleep record written before an aborted sleep
+ * to the backend
+ */
+void battery_history_sleep_wake(void);
+
+/**
+ * @brief Delete the sleep record, e.g. when the history is cleared
+ */
+void battery_history_sleep_clear(void);
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - flash wear and save cost counters
+ *
+ * With ZMK_BATTERY_HISTORY_PERSIST_STATS the counters are kept in a single
+ * record under battery_history_stats/s, written along with every
+ * ZMK_BATTERY_HISTORY_STATS_SAVE_INTERVAL-th save and before sleep. The
+ * stored counters are added to the ones counted before settings were loaded.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include "battery_history_stats.h"
+
+LOG_MODULE_DECLARE(zmk_battery_history, CONFIG_ZMK_LOG_LEVEL);
+
+struct stats_counters {
+    uint32_t saves;
+    uint32_t failed_saves;
+    uint32_t records_written;
+    uint32_t bytes_written;
+    uint32_t recoveries;
+    uint32_t min_save_us;
+    uint32_t max_save_us;
+    uint64_t total_save_us;
+    uint32_t max_sleep_us;
+} __packed;
+
+static struct stats_counters counters;
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_PERSIST_STATS
+struct stats_record {
+    uint16_t crc; // CRC16 of the counters
+    struct stats_counters counters;
+} __packed;
+
+// Nothing is written before the stored counters are merged
+static bool stats_loaded = false;
+static bool stats_dirty = false;
+// Saves accounted since the counters were last written
+static int unpersisted_saves = 0;
+#endif
+
+static uint32_t get_save_count(const struct stats_counters *c) {
+    return c->saves + c->failed_saves;
+}
+
+void battery_history_stats_add_save(int rc, uint32_t bytes, uint32_t save_us) {
+    bool first = get_save_count(&counters) == 0;
+
+    if (rc < 0) {
+        counters.failed_saves++;
+    } else {
+        counters.saves++;
+        counters.records_written += rc;
+    }
+    counters.bytes_written += bytes;
+    counters.min_save_us = first ? save_us : MIN(counters.min_save_us, save_us);
+    counters.max_save_us = MAX(counters.max_save_us, save_us);
+    counters.total_save_us += save_us;
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_PERSIST_STATS
+    stats_dirty = true;
+    if (++unpersisted_saves >= CONFIG_ZMK_BATTERY_HISTORY_STATS_SAVE_INTERVAL) {
+        battery_history_stats_flush();
+    }
+#endif
+}
+
+void battery_history_stats_add_write(uint32_t records, uint32_t bytes) {
+    counters.records_written += records;
+    counters.bytes_written += bytes;
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_PERSIST_STATS
+    stats_dirty = true;
+#endif
+}
+
+void battery_history_stats_add_sleep(uint32_t sleep_us) {
+    counters.max_sleep_us = MAX(counters.max_sleep_us, sleep_us);
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_PERSIST_STATS
+    stats_dirty = true;
+#endif
+}
+
+void battery_history_stats_add_recovery(void) {
+    counters.recoveries++;
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_PERSIST_STATS
+    stats_dirty = true;
+#endif
+}
+
+int battery_history_stats_flush(void) {
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_PERSIST_STATS
+    struct stats_record record;
+
+    if (!stats_loaded || !stats_dirty) {
+        return 0;
+    }
+    // The record accounts for its own write
+    record.counters = counters;
+    record.counters.records_written++;
+    record.counters.bytes_written += sizeof(record);
+    record.crc = crc16_ccitt(0xffff, (const uint8_t *)&record.counters, sizeof(record.counters));
+
+    int rc = settings_save_one("battery_history_stats/s", &record, sizeof(record));
+    if (rc < 0) {
+        LOG_ERR("Failed to save battery history stats: %d", rc);
+        return rc;
+    }
+    counters = record.counters;
+    stats_dirty = false;
+    unpersisted_saves = 0;
+#endif
+    return 0;
+}
+
+void battery_history_stats_get(struct zmk_battery_history_storage_stats *stats) {
+    uint32_t save_count = get_save_count(&counters);
+
+    *stats = (struct zmk_battery_history_storage_stats){
+        .saves = counters.saves,
+        .failed_saves = counters.failed_saves,
+        .records_written = counters.records_written,
+        .bytes_written = counters.bytes_written,
+        .recoveries = counters.recoveries,
+        .min_save_us = counters.min_save_us,
+        .avg_save_us = save_count > 0 ? counters.total_save_us / save_count : 0,
+        .max_save_us = counters.max_save_us,
+        .max_sleep_us = counters.max_sleep_us,
+    };
+}
+
+#ifdef CONFIG_ZMK_BATTERY_HISTORY_PERSIST_STATS
+/**
+ * Add stored counters to the ones counted since boot
+ */
+static void merge_counters(const struct stats_counters *stored) {
+    if (get_save_count(stored) > 0) {
+        counters.min_save_us = get_save_count(&counters) == 0
+                                   ? stored->min_save_us
+                                   : MIN(counters.min_save_us, stored->min_save_us);
+    }
+    counters.saves += stored->saves;
+    counters.failed_saves += stored->failed_saves;
+    counters.records_written += stored->records_written;
+    counters.bytes_written += stored->bytes_written;
+    counters.recoveries += stored->recoveries;
+    counters.max_save_us = MAX(counters.max_save_us, stored->max_save_us);
+    counters.total_save_us += stored->total_save_us;
+    counters.max_sleep_us = MAX(counters.max_sleep_us, stored->max_sleep_us);
+}
+
+static int stats_settings_set(const char *name, size_t len, settings_read_cb read_cb,
+                              void *cb_arg) {
+    struct stats_record record;
+
+    if (strcmp(name, "s")) {
+        return -ENOENT;
+    }
+    if (len != sizeof(record)) {
+        return -EINVAL;
+    }
+    int rc = read_cb(cb_arg, &record, sizeof(record));
+    if (rc < 0) {
+        return rc;
+    }
+    if (record.crc !=
+        crc16_ccitt(0xffff, (const uint8_t *)&record.counters, sizeof(record.counters))) {
+        LOG_WRN("Discarding corrupt battery history stats");
+        return 0;
+    }
+    merge_counters(&record.counters);
+    return 0;
+}
+
+static int stats_settings_commit(void) {
+    stats_loaded = true;
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(battery_history_stats, "battery_history_stats", NULL,
+                               stats_settings_set, stats_settings_commit, NULL);
+#endif
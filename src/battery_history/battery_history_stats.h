@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - flash wear and save cost counters
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <zmk/battery_history/battery_history.h>
+
+/**
+ * @brief Account a save that wrote to storage
+ * @param rc Records written by the save, or negative error code
+ * @param bytes Payload bytes the backend wrote during the save
+ * @param save_us Duration of the save
+ */
+void battery_history_stats_add_save(int rc, uint32_t bytes, uint32_t save_us);
+
+/**
+ * @brief Account records written outside of a save
+ */
+void battery_history_stats_add_write(uint32_t records, uint32_t bytes);
+
+/**
+ * @brief Account the time the history held up entering sleep
+ */
+void battery_history_stats_add_sleep(uint32_t sleep_us);
+
+/**
+ * @brief Account a boot that discarded corrupt records and kept the rest
+ */
+void battery_history_stats_add_recovery(void);
+
+/**
+ * @brief Persist counters changed since they were last written, e.g. before
+ * sleep
+ * @return 0 on success, negative error code on failure
+ */
+int battery_history_stats_flush(void);
+
+/**
+ * @brief Get the counters
+ */
+void battery_history_stats_get(struct zmk_battery_history_storage_stats *stats);
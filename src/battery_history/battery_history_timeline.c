@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - rebasing per-boot timestamps onto the timeline
+ */
+
+#include "battery_history_timeline.h"
+
+void battery_history_rebase_init(struct battery_history_rebase *rebase) {
+    *rebase = (struct battery_history_rebase){0};
+}
+
+uint32_t battery_history_rebase_legacy(struct battery_history_rebase *rebase, uint16_t timestamp) {
+    if (rebase->started && (timestamp < rebase->last_raw || rebase->shift_computed)) {
+        // A new boot, or a legacy entry out of place after timeline entries
+        rebase->offset = rebase->last + BATTERY_HISTORY_REBASE_BOOT_GAP_SEC;
+    }
+    rebase->last_raw = timestamp;
+    rebase->last = rebase->offset + timestamp;
+    rebase->started = true;
+    rebase->shift_computed = false;
+    return rebase->last;
+}
+
+uint32_t battery_history_rebase_current(struct battery_history_rebase *rebase, uint32_t timestamp) {
+    if (!rebase->shift_computed) {
+        rebase->shift = 0;
+        if (rebase->started && timestamp <= rebase->last) {
+            rebase->shift = rebase->last + BATTERY_HISTORY_REBASE_BOOT_GAP_SEC - timestamp;
+        }
+        rebase->shift_computed = true;
+    }
+    rebase->last = timestamp + rebase->shift;
+    rebase->started = true;
+    return rebase->last;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - rebasing per-boot timestamps onto the timeline
+ *
+ * Releases before the timeline stored 16-bit timestamps counting seconds since
+ * boot, so they restart at every reboot and wrap after about 18 hours. The
+ * stored entries are rebased in order, oldest first: a timestamp lower than
+ * the previous one starts a new boot, assumed to begin a minute after the
+ * previous entry, the same guess the web chart used to make. A wrap-around is
+ * indistinguishable from a reboot and rebased the same way.
+ *
+ * Entries already on the timeline that follow the rebased ones are shifted
+ * after them if needed, so the whole history stays increasing.
+ *
+ * This file has no Zephyr dependencies so it can be tested on the host.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Assumed time between the last entry before a reboot and the next boot
+#define BATTERY_HISTORY_REBASE_BOOT_GAP_SEC 60
+
+struct battery_history_rebase {
+    uint32_t offset;     // Timeline time of the boot of the last legacy entry
+    uint32_t last;       // Timeline timestamp of the last entry
+    uint32_t shift;      // Added to the entries already on the timeline
+    uint16_t last_raw;   // Per-boot timestamp of the last legacy entry
+    bool started;        // Whether an entry was rebased yet
+    bool shift_computed; // Whether an entry on the timeline was seen yet
+};
+
+/**
+ * @brief Start rebasing a history, its first legacy entry lands at its own
+ * per-boot timestamp
+ */
+void battery_history_rebase_init(struct battery_history_rebase *rebase);
+
+/**
+ * @brief Rebase the next entry stored with a 16-bit per-boot timestamp
+ * @return Timestamp of the entry on the timeline
+ */
+uint32_t battery_history_rebase_legacy(struct battery_history_rebase *rebase, uint16_t timestamp);
+
+/**
+ * @brief Place the next entry already stored with a timeline timestamp
+ * @return Timestamp of the entry, shifted after the rebased entries if needed
+ */
+uint32_t battery_history_rebase_current(struct battery_history_rebase *rebase, uint32_t timestamp);
+
+/**
+ * @brief Timestamp of the last entry passed in, meaningless if none was
+ */
+static inline uint32_t battery_history_rebase_last(const struct battery_history_rebase *rebase) {
+    return rebase->last;
+}
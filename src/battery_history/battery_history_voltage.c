@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - millivolt filter and encoding
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+
+#include "battery_history_voltage.h"
+
+void battery_history_voltage_filter_init(struct battery_history_voltage_filter *filter,
+                                         int shift) {
+    filter->count = 0;
+    filter->next = 0;
+    filter->shift = (uint8_t)shift;
+    filter->average = 0;
+}
+
+static uint16_t median(const struct battery_history_voltage_filter *filter) {
+    uint16_t a = filter->window[0], b = filter->window[1], c = filter->window[2];
+
+    if (filter->count < BATTERY_HISTORY_VOLTAGE_MEDIAN) {
+        // Not enough readings to tell a sag from a drop yet
+        return filter->window[(filter->next + BATTERY_HISTORY_VOLTAGE_MEDIAN - 1) %
+                              BATTERY_HISTORY_VOLTAGE_MEDIAN];
+    }
+    if (a > b) {
+        uint16_t t = a;
+        a = b;
+        b = t;
+    }
+    // With a <= b, the median is c clamped to [a, b]
+    return c < a ? a : c > b ? b : c;
+}
+
+uint16_t battery_history_voltage_filter_update(struct battery_history_voltage_filter *filter,
+                                               uint16_t millivolts) {
+    filter->window[filter->next] = millivolts;
+    filter->next = (filter->next + 1) % BATTERY_HISTORY_VOLTAGE_MEDIAN;
+    bool first = filter->count == 0;
+    if (filter->count < BATTERY_HISTORY_VOLTAGE_MEDIAN) {
+        filter->count++;
+    }
+
+    int32_t target = (int32_t)median(filter) << 8;
+    if (first) {
+        filter->average = target;
+    } else {
+        // Divided rather than shifted, so drops and rises are rounded alike
+        filter->average += (target - filter->average) / (1 << filter->shift);
+    }
+    return (uint16_t)((filter->average + 128) >> 8);
+}
+
+static int write_varint(uint8_t *buf, size_t size, size_t *pos, uint32_t value) {
+    do {
+        if (*pos >= size) {
+            return -ENOMEM;
+        }
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        buf[(*pos)++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return 0;
+}
+
+static int read_varint(const uint8_t *buf, size_t len, size_t *pos, uint32_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*pos >= len) {
+            return -EINVAL;
+        }
+        uint8_t byte = buf[(*pos)++];
+        *value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+int battery_history_voltage_encode(const struct zmk_battery_history_voltage_sample *samples,
+                                   int count, uint8_t *buf, size_t size) {
+    if (count < 1) {
+        return -EINVAL;
+    }
+    if (size < BATTERY_HISTORY_VOLTAGE_HEADER_SIZE) {
+        return -ENOMEM;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        buf[i] = (uint8_t)(samples[0].timestamp >> (8 * i));
+    }
+    buf[4] = (uint8_t)samples[0].millivolts;
+    buf[5] = (uint8_t)(samples[0].millivolts >> 8);
+
+    size_t pos = BATTERY_HISTORY_VOLTAGE_HEADER_SIZE;
+    for (int i = 1; i < count; i++) {
+        // Taken modulo 2^32, so runs that are not increasing still round-trip
+        uint32_t dt = samples[i].timestamp - samples[i - 1].timestamp;
+        int32_t dv = (int32_t)samples[i].millivolts - (int32_t)samples[i - 1].millivolts;
+        // Zigzag: small positive and negative deltas map to small codes
+        uint32_t zz = dv >= 0 ? (uint32_t)dv * 2 : (uint32_t)-dv * 2 - 1;
+
+        int rc = write_varint(buf, size, &pos, dt);
+        if (rc == 0) {
+            rc = write_varint(buf, size, &pos, zz);
+        }
+        if (rc < 0) {
+            return rc;
+        }
+    }
+    return (int)pos;
+}
+
+int battery_history_voltage_decode(const uint8_t *buf, size_t len,
+                                   struct zmk_battery_history_voltage_sample *samples,
+                                   int max_count) {
+    if (len < BATTERY_HISTORY_VOLTAGE_HEADER_SIZE || max_count < 1) {
+        return -EINVAL;
+    }
+
+    samples[0].timestamp = 0;
+    for (int i = 0; i < 4; i++) {
+        samples[0].timestamp |= (uint32_t)buf[i] << (8 * i);
+    }
+    samples[0].millivolts = (uint16_t)(buf[4] | buf[5] << 8);
+
+    size_t pos = BATTERY_HISTORY_VOLTAGE_HEADER_SIZE;
+    int count = 1;
+    while (pos < len) {
+        uint32_t dt, zz;
+
+        if (count >= max_count || read_varint(buf, len, &pos, &dt) < 0 ||
+            read_varint(buf, len, &pos, &zz) < 0) {
+            return -EINVAL;
+        }
+        int32_t dv = (zz & 1) ? -(int32_t)((zz + 1) / 2) : (int32_t)(zz / 2);
+        int32_t millivolts = (int32_t)samples[count - 1].millivolts + dv;
+        if (millivolts < 0 || millivolts > UINT16_MAX) {
+            return -EINVAL;
+        }
+        samples[count].timestamp = samples[count - 1].timestamp + dt;
+        samples[count].millivolts = (uint16_t)millivolts;
+        count++;
+    }
+    return count;
+}
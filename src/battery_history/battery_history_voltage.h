@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Battery History - millivolt filter and encoding
+ *
+ * Voltage readings sag while the radio transmits and carry a few millivolts
+ * of ADC noise. A reading is first replaced by the median of the last three,
+ * which drops single sags, then smoothed by an exponential moving average in
+ * 24.8 fixed point with a weight of 1 / 2^shift.
+ *
+ * A run of samples is stored as the first sample verbatim followed by the
+ * timestamp delta and zigzag-encoded millivolt delta of every further sample,
+ * each as a little-endian base-128 varint:
+ *
+ *   u32 first timestamp | u16 first millivolts | (count - 1) x (time delta,
+ *   millivolt delta) varints
+ *
+ * A sample a few minutes and millivolts after the previous one takes 3 bytes.
+ *
+ * This file has no Zephyr dependencies so it can be tested on the host.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zmk/battery_history/battery_history.h>
+
+#define BATTERY_HISTORY_VOLTAGE_MEDIAN 3
+
+struct battery_history_voltage_filter {
+    uint16_t window[BATTERY_HISTORY_VOLTAGE_MEDIAN]; // Latest readings, oldest replaced first
+    uint8_t count;                                   // Readings taken, up to the window size
+    uint8_t next;                                    // Window slot of the next reading
+    uint8_t shift;                                   // Moving average weight is 1 / 2^shift
+    int32_t average;                                 // Moving average in 1/256 millivolts
+};
+
+#define BATTERY_HISTORY_VOLTAGE_HEADER_SIZE 6
+
+/**
+ * @brief Worst-case encoded size of a run of samples
+ */
+#define BATTERY_HISTORY_VOLTAGE_MAX_SIZE(count)                                                    \
+    (BATTERY_HISTORY_VOLTAGE_HEADER_SIZE + ((count) - 1) * (5 + 3))
+
+/**
+ * @brief Set up a filter taking its first reading as is
+ * @param shift Moving average weight is 1 / 2^shift, 0 only takes the median
+ */
+void battery_history_voltage_filter_init(struct battery_history_voltage_filter *filter,
+                                         int shift);
+
+/**
+ * @brief Feed a reading through the filter
+ * @param millivolts Voltage read
+ * @return Filtered voltage in millivolts
+ */
+uint16_t battery_history_voltage_filter_update(struct battery_history_voltage_filter *filter,
+                                               uint16_t millivolts);
+
+/**
+ * @brief Encode a run of samples
+ * @param samples Samples to encode, oldest first
+ * @param count Number of samples, at least 1
+ * @param buf Output buffer
+ * @param size Size of the output buffer
+ * @return Number of bytes written, or negative error code
+ */
+int battery_history_voltage_encode(const struct zmk_battery_history_voltage_sample *samples,
+                                   int count, uint8_t *buf, size_t size);
+
+/**
+ * @brief Decode a run of samples
+ * @param buf Encoded data
+ * @param len Length of the encoded data
+ * @param samples Output samples
+ * @param max_count Capacity of the output array
+ * @return Number of samples decoded, or negative error code
+ */
+int battery_history_voltage_decode(const uint8_t *buf, size_t len,
+                                   struct zmk_battery_history_voltage_sample *samples,
+                                   int max_count);
@@ -1,6 +1,7 @@
 import platform
 import shutil
 import subprocess
+import tempfile
 import unittest
 from pathlib import Path
 
@@ -41,6 +42,9 @@ class WestCommandsTests(unittest.TestCase):
         result = run_west(["zmk-test", "tests", '-m', '.' , '-v'])
         self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
         self.assertIn("PASS: battery-history", result.stdout)
+        self.assertIn("PASS: battery-history-nvs", result.stdout)
+        self.assertIn("PASS: battery-history-file", result.stdout)
+        self.assertIn("PASS: battery-history-ram", result.stdout)
 
     def test_zmk_build(self):
         artifacts_and_expected_config: dict[str, list[str | NotFound]] = {
@@ -77,5 +81,65 @@ class WestCommandsTests(unittest.TestCase):
                         self.fail(f"{entry} not found in {config_path} for {artifact}")
             self.assertTrue((config_path.parent / "zmk.uf2").exists(), f"{artifact} zmk.uf2 is missing in {config_path.parent}")
 
+class HostTests(unittest.TestCase):
+    """Tests of Zephyr-independent sources, compiled with the host C compiler"""
+
+    def run_host_test(self, name: str, sources: list[str]) -> str:
+        with tempfile.TemporaryDirectory() as tmp:
+            exe = Path(tmp) / name
+            result = subprocess.run(
+                [
+                    "cc", "-std=c11", "-Wall", "-Wextra", "-Werror",
+                    "-I", str(THIS_DIR / "include"),
+                    "-I", str(THIS_DIR / "src" / "battery_history"),
+                    "-I", str(THIS_DIR / "tests" / "host" / "include"),
+                    str(THIS_DIR / "tests" / "host" / f"{name}.c"),
+                    *[str(THIS_DIR / source) for source in sources],
+                    "-o", str(exe),
+                ],
+                capture_output=True,
+                text=True,
+            )
+            self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+            result = subprocess.run([str(exe)], capture_output=True, text=True)
+            self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+            return result.stdout
+
+    def test_codec_roundtrip(self):
+        output = self.run_host_test("codec_test", ["src/battery_history/battery_history_codec.c"])
+        self.assertIn("cases ok", output)
+
+    def test_save_budget(self):
+        output = self.run_host_test("budget_test", ["src/battery_history/battery_history_budget.c"])
+        self.assertIn("save budget bounded", output)
+
+    def test_timeline_rebase(self):
+        output = self.run_host_test("timeline_test", ["src/battery_history/battery_history_timeline.c"])
+        self.assertIn("timeline rebased", output)
+
+    def test_adaptive_interval(self):
+        output = self.run_host_test("interval_test", ["src/battery_history/battery_history_interval.c"])
+        self.assertIn("adaptive interval ok", output)
+
+    def test_level_filter(self):
+        output = self.run_host_test("filter_test", ["src/battery_history/battery_history_filter.c"])
+        self.assertIn("level filter ok", output)
+
+    def test_millivolts(self):
+        output = self.run_host_test("voltage_test", ["src/battery_history/battery_history_voltage.c"])
+        self.assertIn("millivolts ok", output)
+
+    def test_nvs_log_replay(self):
+        output = self.run_host_test("nvs_test", [])
+        self.assertIn("nvs log replay ok", output)
+
+    def test_file_segments(self):
+        output = self.run_host_test("file_test", [])
+        self.assertIn("file segments ok", output)
+
+    def test_ram_backend(self):
+        output = self.run_host_test("ram_test", [])
+        self.assertIn("ram backend ok", output)
+
 if __name__ == "__main__":
     unittest.main()
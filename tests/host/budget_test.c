@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host-side test of the flash save budget.
+ */
+
+#include <stdio.h>
+
+#include "battery_history_budget.h"
+
+#define SAVES_PER_DAY 48
+#define BURST 4
+#define MS_PER_DAY (24LL * 60 * 60 * 1000)
+
+static uint32_t rng_state = 12345;
+
+static uint32_t next_random(void) {
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 16;
+}
+
+int main(void) {
+    struct battery_history_budget budget;
+    int failures = 0;
+
+    // A single token at boot, then regular saves have to wait for the refill
+    battery_history_budget_init(&budget, SAVES_PER_DAY, BURST, 1000);
+    if (battery_history_budget_take(&budget, 1000, false) != 0) {
+        printf("first save refused\n");
+        failures++;
+    }
+    int64_t wait_ms = battery_history_budget_take(&budget, 1000, false);
+    if (wait_ms != MS_PER_DAY / SAVES_PER_DAY) {
+        printf("unexpected wait %lld ms\n", (long long)wait_ms);
+        failures++;
+    }
+    if (battery_history_budget_take(&budget, 1000 + wait_ms - 1, false) == 0 ||
+        battery_history_budget_take(&budget, 1000 + wait_ms, false) != 0) {
+        printf("save not allowed exactly after the wait\n");
+        failures++;
+    }
+
+    // Urgent saves overdraw by one burst and no further
+    int urgent = 0;
+    while (battery_history_budget_take(&budget, 1000 + wait_ms, true) == 0) {
+        urgent++;
+    }
+    if (urgent != BURST) {
+        printf("urgent saves overdrew %d tokens\n", urgent);
+        failures++;
+    }
+
+    // Flapping input: a save request every few seconds for a week, some urgent
+    const int days = 7;
+    int allowed = 0;
+    battery_history_budget_init(&budget, SAVES_PER_DAY, BURST, 0);
+    for (int64_t now = 0; now < days * MS_PER_DAY; now += 1 + next_random() % 5000) {
+        if (battery_history_budget_take(&budget, now, next_random() % 8 == 0) == 0) {
+            allowed++;
+        }
+    }
+    if (allowed > 1 + BURST + days * SAVES_PER_DAY || allowed < days * SAVES_PER_DAY) {
+        printf("flapping input got %d saves\n", allowed);
+        failures++;
+    }
+
+    // Banked refill is capped at one burst after a long idle period
+    battery_history_budget_init(&budget, SAVES_PER_DAY, BURST, 0);
+    allowed = 0;
+    while (battery_history_budget_take(&budget, 10 * MS_PER_DAY, false) == 0) {
+        allowed++;
+    }
+    if (allowed != BURST) {
+        printf("idle budget allowed %d saves\n", allowed);
+        failures++;
+    }
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("save budget bounded\n");
+    return 0;
+}
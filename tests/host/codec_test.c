@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host-side round-trip test of the compressed entry encoding.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "battery_history_codec.h"
+
+#define MAX_RUN 64
+
+static uint32_t rng_state = 12345;
+
+static uint32_t next_random(void) {
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 16;
+}
+
+static int round_trip(const struct zmk_battery_history_entry *entries, int count) {
+    uint8_t buf[BATTERY_HISTORY_CODEC_MAX_SIZE(MAX_RUN)];
+    struct zmk_battery_history_entry decoded[MAX_RUN];
+
+    int len = battery_history_codec_encode(entries, count, buf, sizeof(buf));
+    if (len < 0 || len > (int)BATTERY_HISTORY_CODEC_MAX_SIZE(count)) {
+        printf("encode failed: count=%d rc=%d\n", count, len);
+        return 1;
+    }
+    int n = battery_history_codec_decode(buf, len, decoded, MAX_RUN);
+    if (n != count || memcmp(entries, decoded, count * sizeof(*entries)) != 0) {
+        printf("round-trip mismatch: count=%d decoded=%d\n", count, n);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    struct zmk_battery_history_entry entries[MAX_RUN];
+    int failures = 0;
+    int cases = 0;
+
+    // Typical discharge: 5 minute steps, dropping 1% at a time
+    for (int i = 0; i < MAX_RUN; i++) {
+        entries[i].timestamp = 300 * (i + 1);
+        entries[i].battery_level = 100 - i;
+    }
+    for (int count = 1; count <= MAX_RUN; count++, cases++) {
+        failures += round_trip(entries, count);
+    }
+
+    // Constant level and timestamp: zero-width fields
+    for (int i = 0; i < MAX_RUN; i++) {
+        entries[i].timestamp = 42;
+        entries[i].battery_level = 50;
+    }
+    failures += round_trip(entries, MAX_RUN);
+    cases++;
+
+    // Timestamps past 16 bits, a wrap at 32 bits, extreme level jumps
+    const struct zmk_battery_history_entry edges[] = {
+        {65000, 0}, {65535, 100}, {65536, 0}, {4000000000u, 100},
+        {4294967295u, 1}, {0, 99}, {1, 0},
+    };
+    failures += round_trip(edges, sizeof(edges) / sizeof(edges[0]));
+    cases++;
+
+    // Random runs
+    for (int iter = 0; iter < 1000; iter++, cases++) {
+        int count = 1 + next_random() % MAX_RUN;
+        for (int i = 0; i < count; i++) {
+            entries[i].timestamp = next_random() << 16 | next_random();
+            entries[i].battery_level = next_random() % 101;
+        }
+        failures += round_trip(entries, count);
+    }
+
+    // Corrupt input must be rejected rather than decoded out of bounds
+    uint8_t bad[BATTERY_HISTORY_CODEC_HEADER_SIZE] = {5, 0, 0, 0, 0, 50, 33, 0};
+    struct zmk_battery_history_entry decoded[MAX_RUN];
+    if (battery_history_codec_decode(bad, sizeof(bad), decoded, MAX_RUN) >= 0) {
+        printf("corrupt header accepted\n");
+        failures++;
+    }
+    cases++;
+
+    if (failures) {
+        printf("codec round-trip: %d of %d cases failed\n", failures, cases);
+        return 1;
+    }
+    printf("codec round-trip: %d cases ok\n", cases);
+    return 0;
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host-side test of rotating the history file segments and replaying them
+ * after a reboot, on in-memory files.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES 192
+#define CONFIG_ZMK_BATTERY_HISTORY_FILE_MAX_ENTRIES 256
+#define CONFIG_ZMK_BATTERY_HISTORY_FILE_PATH "/lfs/battery_history"
+
+// The firmware is built with Zephyr's warnings, not -Wextra
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wsign-compare"
+#include "battery_history_file.c"
+
+// Room for a full segment and a torn record
+#define FILE_SIZE ((SEGMENT_ENTRIES + 1) * sizeof(struct file_record))
+
+static struct fake_file {
+    char path[32];
+    bool exists;
+    size_t size;
+    uint8_t data[FILE_SIZE];
+} files[3];
+
+static struct open_file {
+    struct fake_file *file;
+    size_t pos;
+} open_files[2];
+
+static struct fake_file *find_file(const char *path) {
+    for (int i = 0; i < (int)ARRAY_SIZE(files); i++) {
+        if (files[i].exists && strcmp(files[i].path, path) == 0) {
+            return &files[i];
+        }
+    }
+    return NULL;
+}
+
+int fs_open(struct fs_file_t *zfp, const char *file_name, fs_mode_t flags) {
+    struct fake_file *file = find_file(file_name);
+    if (!file && !(flags & FS_O_CREATE)) {
+        return -ENOENT;
+    }
+    for (int i = 0; !file && i < (int)ARRAY_SIZE(files); i++) {
+        if (!files[i].exists) {
+            file = &files[i];
+            snprintf(file->path, sizeof(file->path), "%s", file_name);
+            file->exists = true;
+            file->size = 0;
+        }
+    }
+    for (int i = 0; i < (int)ARRAY_SIZE(open_files); i++) {
+        if (!open_files[i].file) {
+            open_files[i].file = file;
+            open_files[i].pos = 0;
+            zfp->filep = &open_files[i];
+            zfp->flags = flags;
+            return 0;
+        }
+    }
+    return -ENFILE;
+}
+
+int fs_close(struct fs_file_t *zfp) {
+    struct open_file *open = zfp->filep;
+    open->file = NULL;
+    return 0;
+}
+
+ssize_t fs_read(struct fs_file_t *zfp, void *ptr, size_t size) {
+    struct open_file *open = zfp->filep;
+    size_t n = open->pos < open->file->size ? MIN(size, open->file->size - open->pos) : 0;
+    memcpy(ptr, open->file->data + open->pos, n);
+    open->pos += n;
+    return n;
+}
+
+ssize_t fs_write(struct fs_file_t *zfp, const void *ptr, size_t size) {
+    struct open_file *open = zfp->filep;
+    if (zfp->flags & FS_O_APPEND) {
+        open->pos = open->file->size;
+    }
+    if (open->pos + size > FILE_SIZE) {
+        return -ENOSPC;
+    }
+    memcpy(open->file->data + open->pos, ptr, size);
+    open->pos += size;
+    open->file->size = MAX(open->file->size, open->pos);
+    return size;
+}
+
+int fs_seek(struct fs_file_t *zfp, off_t offset, int whence) {
+    struct open_file *open = zfp->filep;
+    open->pos = (whence == FS_SEEK_END ? open->file->size : 0) + offset;
+    return 0;
+}
+
+int fs_truncate(struct fs_file_t *zfp, off_t length) {
+    struct open_file *open = zfp->filep;
+    open->file->size = MIN(open->file->size, (size_t)length);
+    return 0;
+}
+
+int fs_stat(const char *path, struct fs_dirent *entry) {
+    struct fake_file *file = find_file(path);
+    if (!file) {
+        return -ENOENT;
+    }
+    entry->size = file->size;
+    return 0;
+}
+
+int fs_unlink(const char *path) {
+    struct fake_file *file = find_file(path);
+    if (!file) {
+        return -ENOENT;
+    }
+    file->exists = false;
+    return 0;
+}
+
+int fs_rename(const char *from, const char *to) {
+    struct fake_file *file = find_file(from);
+    if (!file) {
+        return -ENOENT;
+    }
+    fs_unlink(to);
+    snprintf(file->path, sizeof(file->path), "%s", to);
+    return 0;
+}
+
+static struct zmk_battery_history_entry restored[CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES];
+static int restored_count;
+static int discarded;
+
+void battery_history_restore_entry(const struct zmk_battery_history_entry *entry) {
+    if (restored_count < CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES) {
+        restored[restored_count] = *entry;
+    }
+    restored_count++;
+}
+
+void battery_history_count_discarded(void) { discarded++; }
+
+static struct zmk_battery_history_entry make_entry(int i) {
+    return (struct zmk_battery_history_entry){.timestamp = 1000 + 60 * i,
+                                              .battery_level = 100 - i % 100};
+}
+
+/**
+ * Drop the backend state and open the files again, like a boot
+ */
+static void reboot(void) {
+    segment_counts[0] = 0;
+    segment_counts[1] = 0;
+    cache.count = 0;
+    restored_count = 0;
+    discarded = 0;
+    battery_history_backend.load();
+}
+
+/**
+ * Append total entries, batch at a time, and replay them after a reboot
+ */
+static int check_replay(int total, int batch) {
+    struct zmk_battery_history_entry entries[64];
+    int failures = 0;
+
+    battery_history_backend.clear();
+    for (int written = 0; written < total; written += batch) {
+        int n = MIN(batch, total - written);
+        for (int i = 0; i < n; i++) {
+            entries[i] = make_entry(written + i);
+        }
+        battery_history_backend.append(written, entries, n);
+
+        // Between half and all of the capacity is kept once a segment is full
+        int stored = battery_history_backend.get_stored_count();
+        if (stored != written + n &&
+            (stored < SEGMENT_ENTRIES || stored > CONFIG_ZMK_BATTERY_HISTORY_FILE_MAX_ENTRIES)) {
+            printf("%d entries in batches of %d: %d stored\n", written + n, batch, stored);
+            return 1;
+        }
+    }
+
+    // The older segment starts at a multiple of the segment size
+    int oldest = 0;
+    if (total > SEGMENT_ENTRIES) {
+        oldest = ((total - 1) / SEGMENT_ENTRIES - 1) * SEGMENT_ENTRIES;
+    }
+    int stored = total - oldest;
+
+    reboot();
+    if (battery_history_backend.get_stored_count() != stored) {
+        printf("%d entries in batches of %d: %d stored after reboot, expected %d\n", total, batch,
+               battery_history_backend.get_stored_count(), stored);
+        return 1;
+    }
+    int replayed = MIN(stored, BATTERY_HISTORY_RING_ENTRIES);
+    if (restored_count != replayed || discarded != 0) {
+        printf("%d entries in batches of %d: %d replayed, %d discarded, expected %d\n", total,
+               batch, restored_count, discarded, replayed);
+        return 1;
+    }
+    for (int i = 0; i < replayed; i++) {
+        struct zmk_battery_history_entry expected = make_entry(total - replayed + i);
+        if (memcmp(&restored[i], &expected, sizeof(expected)) != 0) {
+            printf("%d entries in batches of %d: replayed entry %d differs\n", total, batch, i);
+            failures++;
+            break;
+        }
+    }
+    for (int i = 0; i < stored; i++) {
+        struct zmk_battery_history_entry entry, expected = make_entry(oldest + i);
+        if (battery_history_backend.read_stored(i, &entry) != 0 ||
+            memcmp(&entry, &expected, sizeof(expected)) != 0) {
+            printf("%d entries in batches of %d: stored entry %d differs\n", total, batch, i);
+            failures++;
+            break;
+        }
+    }
+    return failures;
+}
+
+int main(void) {
+    static const int totals[] = {0, 1, 127, 128, 129, 191, 256, 257, 300, 1000};
+    static const int batches[] = {1, 7, 40};
+    int failures = 0;
+
+    for (int t = 0; t < (int)ARRAY_SIZE(totals); t++) {
+        for (int b = 0; b < (int)ARRAY_SIZE(batches); b++) {
+            failures += check_replay(totals[t], batches[b]);
+        }
+    }
+
+    // A record torn by a reset during an append is cut off
+    check_replay(300, 7);
+    struct fake_file *active = find_file(segment_paths[1]);
+    memset(active->data + active->size, 0xa5, 3);
+    active->size += 3;
+    reboot();
+    if (battery_history_backend.get_stored_count() != 172 ||
+        active->size % sizeof(struct file_record) != 0 || discarded != 0) {
+        printf("torn record: %d stored, file size %zu\n",
+               battery_history_backend.get_stored_count(), active->size);
+        failures++;
+    }
+
+    // A corrupt record is skipped by the replay and reported when read
+    active->data[active->size - 2] ^= 0xff;
+    reboot();
+    struct zmk_battery_history_entry entry;
+    if (restored_count != 171 || discarded != 1 ||
+        battery_history_backend.read_stored(171, &entry) != -EBADMSG) {
+        printf("corrupt record: %d replayed, %d discarded\n", restored_count, discarded);
+        failures++;
+    }
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("file segments ok\n");
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host-side replay of a noisy discharge through the level hysteresis filter.
+ */
+
+#include <stdio.h>
+
+#include "battery_history_filter.h"
+
+#define MINUTE_MS (60LL * 1000)
+#define DEADBAND 1
+#define DWELL_MS (10 * MINUTE_MS)
+
+static uint32_t rng_state = 12345;
+
+static uint32_t next_random(void) {
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 16;
+}
+
+/**
+ * Level read at the given minute of a 3-day discharge, with up to 0.5% of
+ * jitter so readings near a boundary bounce between two levels
+ */
+static int read_level(int minute, double *actual) {
+    *actual = 100.0 - minute * 100.0 / (3 * 24 * 60);
+    double noise = ((int)(next_random() % 1001) - 500) / 1000.0;
+    int level = (int)(*actual + noise + 0.5);
+    return level < 0 ? 0 : level > 100 ? 100 : level;
+}
+
+int main(void) {
+    struct battery_history_filter filter;
+    int failures = 0;
+
+    // Flapping readings are held, a persisting change is accepted after the dwell
+    battery_history_filter_init(&filter, DEADBAND, DWELL_MS, false);
+    battery_history_filter_update(&filter, 0, 72, false);
+    for (int i = 1; i < 60; i++) {
+        if (battery_history_filter_update(&filter, i * MINUTE_MS, 72 - i % 2, false) != 72) {
+            printf("flapping reading accepted\n");
+            failures++;
+            break;
+        }
+    }
+    battery_history_filter_update(&filter, 60 * MINUTE_MS, 71, false);
+    if (battery_history_filter_update(&filter, 70 * MINUTE_MS, 71, false) != 71) {
+        printf("persisting change not accepted after the dwell\n");
+        failures++;
+    }
+    if (battery_history_filter_update(&filter, 71 * MINUTE_MS, 68, false) != 68) {
+        printf("change beyond the dead-band not accepted right away\n");
+        failures++;
+    }
+
+    // Monotonic while discharging, rises within the dead-band need charging
+    battery_history_filter_init(&filter, DEADBAND, DWELL_MS, true);
+    battery_history_filter_update(&filter, 0, 50, false);
+    battery_history_filter_update(&filter, 0, 51, false);
+    if (battery_history_filter_update(&filter, 60 * MINUTE_MS, 51, false) != 50 ||
+        battery_history_filter_update(&filter, 70 * MINUTE_MS, 51, true) != 50 ||
+        battery_history_filter_update(&filter, 80 * MINUTE_MS, 51, true) != 51) {
+        printf("monotonic filter accepted a rise while discharging\n");
+        failures++;
+    }
+
+    // Replay: count entries, i.e. changes of the level that would be recorded
+    int raw_entries = 0, entries = 0;
+    int raw_level = -1, level = -1;
+    double max_error = 0;
+    battery_history_filter_init(&filter, DEADBAND, DWELL_MS, true);
+    for (int minute = 0; minute < 3 * 24 * 60; minute++) {
+        double actual;
+        int reading = read_level(minute, &actual);
+        int filtered = battery_history_filter_update(&filter, minute * MINUTE_MS, reading, false);
+
+        raw_entries += reading != raw_level;
+        raw_level = reading;
+        entries += filtered != level;
+        level = filtered;
+        double error = level > actual ? level - actual : actual - level;
+        if (error > max_error) {
+            max_error = error;
+        }
+    }
+    printf("noisy trace: %d entries unfiltered, %d filtered, max error %.1f%%\n", raw_entries,
+           entries, max_error);
+    if (entries > 101) {
+        printf("filter let noise through\n");
+        failures++;
+    }
+    if (max_error > DEADBAND + 1) {
+        printf("filtered level lagged too far behind\n");
+        failures++;
+    }
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("level filter ok\n");
+    return 0;
+}
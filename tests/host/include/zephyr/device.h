@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host stand-in for the Zephyr header, only what the sources under test use.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+struct device {
+    const char *name;
+};
+
+static inline bool device_is_ready(const struct device *dev) { return dev != NULL; }
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host stand-in for the Zephyr header, only what the sources under test use.
+ * The flash has 4 KiB pages.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <zephyr/device.h>
+
+struct flash_pages_info {
+    off_t start_offset;
+    size_t size;
+    uint32_t index;
+};
+
+static inline int flash_get_page_info_by_offs(const struct device *dev, off_t offset,
+                                              struct flash_pages_info *info) {
+    (void)dev;
+    info->size = 4096;
+    info->index = offset / info->size;
+    info->start_offset = info->index * info->size;
+    return 0;
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host stand-in for the Zephyr header. The functions are implemented by the
+ * test, usually as a map from ID to the last data written.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <zephyr/device.h>
+
+struct nvs_fs {
+    off_t offset;
+    uint16_t sector_size;
+    uint16_t sector_count;
+    const struct device *flash_device;
+};
+
+int nvs_mount(struct nvs_fs *fs);
+int nvs_clear(struct nvs_fs *fs);
+ssize_t nvs_write(struct nvs_fs *fs, uint16_t id, const void *data, size_t len);
+int nvs_delete(struct nvs_fs *fs, uint16_t id);
+ssize_t nvs_read(struct nvs_fs *fs, uint16_t id, void *data, size_t len);
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host stand-in for the Zephyr header, only what the sources under test use.
+ * Log messages are dropped.
+ */
+
+#pragma once
+
+#define LOG_MODULE_DECLARE(name, level) extern int host_log_module_unused
+
+static inline void host_log_drop(const char *format, ...) { (void)format; }
+
+#define LOG_ERR(...) host_log_drop(__VA_ARGS__)
+#define LOG_WRN(...) host_log_drop(__VA_ARGS__)
+#define LOG_INF(...) host_log_drop(__VA_ARGS__)
+#define LOG_DBG(...) host_log_drop(__VA_ARGS__)
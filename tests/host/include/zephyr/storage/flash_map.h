@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host stand-in for the Zephyr header, only what the sources under test use.
+ * Every partition exists and is 32 KiB at the start of a single flash device.
+ */
+
+#pragma once
+
+#include <zephyr/device.h>
+
+static const struct device host_flash_device = {.name = "flash"};
+
+#define FIXED_PARTITION_EXISTS(label) 1
+#define FIXED_PARTITION_DEVICE(label) (&host_flash_device)
+#define FIXED_PARTITION_OFFSET(label) 0
+#define FIXED_PARTITION_SIZE(label) 0x8000
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host stand-in for the Zephyr header, computing the same CRCs as Zephyr.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+static inline uint16_t crc16_ccitt(uint16_t seed, const uint8_t *src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint8_t e = seed ^ src[i];
+        uint8_t f = e ^ (e << 4);
+        seed = (seed >> 8) ^ ((uint16_t)f << 8) ^ ((uint16_t)f << 3) ^ (f >> 4);
+    }
+    return seed;
+}
+
+static inline uint8_t crc8_ccitt(uint8_t val, const void *buf, size_t cnt) {
+    const uint8_t *p = buf;
+
+    for (size_t i = 0; i < cnt; i++) {
+        val ^= p[i];
+        for (int bit = 0; bit < 8; bit++) {
+            val = (val & 0x80) ? (uint8_t)((val << 1) ^ 0x07) : (uint8_t)(val << 1);
+        }
+    }
+    return val;
+}
@@ -0,0 +1,11 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host stand-in for the Zephyr header, only what the sources under test use.
+ */
+
+#pragma once
+
+#define __packed __attribute__((__packed__))
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host-side benchmark of the adaptive recording interval against the fixed
+ * one, replaying a week of daily discharges.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "battery_history_interval.h"
+
+#define MINUTE_MS (60LL * 1000)
+#define HOUR_MS (60 * MINUTE_MS)
+#define DAY_MS (24 * HOUR_MS)
+
+#define FIXED_MS (5 * MINUTE_MS)
+#define MIN_MS (1 * MINUTE_MS)
+#define MAX_MS (60 * MINUTE_MS)
+
+struct result {
+    int wakeups;
+    int changes;
+    int64_t total_latency_ms; // From a level change to the sample seeing it
+    int64_t max_latency_ms;
+};
+
+/**
+ * Charged every morning, 8 hours of typing at 1% per 12 minutes, then idle
+ * at 1% per 4 hours
+ */
+static int get_level(int64_t now_ms) {
+    int64_t t = now_ms % DAY_MS;
+    if (t < 8 * HOUR_MS) {
+        return 100 - (int)(t / (12 * MINUTE_MS));
+    }
+    return 60 - (int)((t - 8 * HOUR_MS) / (4 * HOUR_MS));
+}
+
+static struct result replay(bool adaptive) {
+    struct battery_history_interval interval;
+    struct result result = {0};
+    int64_t next_ms = 0;
+    int64_t pending_ms = -1;
+    int level = get_level(0);
+
+    battery_history_interval_init(&interval, MIN_MS, MAX_MS);
+    for (int64_t now = 0; now < 7 * DAY_MS; now += 1000) {
+        if (get_level(now) != level) {
+            level = get_level(now);
+            result.changes++;
+            if (pending_ms < 0) {
+                pending_ms = now;
+            }
+        }
+        if (now < next_ms) {
+            continue;
+        }
+        result.wakeups++;
+        if (pending_ms >= 0) {
+            int64_t latency_ms = now - pending_ms;
+            result.total_latency_ms += latency_ms;
+            if (latency_ms > result.max_latency_ms) {
+                result.max_latency_ms = latency_ms;
+            }
+            pending_ms = -1;
+        }
+        next_ms = now + (adaptive ? battery_history_interval_next(&interval, now, level)
+                                  : FIXED_MS);
+    }
+    return result;
+}
+
+int main(void) {
+    struct battery_history_interval interval;
+    int failures = 0;
+
+    // Bounds hold from the first sample on
+    battery_history_interval_init(&interval, MIN_MS, MAX_MS);
+    if (battery_history_interval_next(&interval, 0, 80) != MIN_MS) {
+        printf("first sample not at the lower bound\n");
+        failures++;
+    }
+    if (battery_history_interval_next(&interval, 10 * DAY_MS, 80) != MAX_MS) {
+        printf("flat level not at the upper bound\n");
+        failures++;
+    }
+    // A fast drop after a long flat period shrinks the interval right away
+    battery_history_interval_next(&interval, 10 * DAY_MS + 10 * MINUTE_MS, 79);
+    if (battery_history_interval_next(&interval, 10 * DAY_MS + 12 * MINUTE_MS, 78) !=
+        MINUTE_MS) {
+        printf("fast drain did not shrink the interval\n");
+        failures++;
+    }
+
+    struct result fixed = replay(false);
+    struct result adaptive = replay(true);
+    printf("fixed: %d wakeups, %d changes, avg latency %lld s, max %lld s\n", fixed.wakeups,
+           fixed.changes, (long long)(fixed.total_latency_ms / fixed.changes / 1000),
+           (long long)(fixed.max_latency_ms / 1000));
+    printf("adaptive: %d wakeups, %d changes, avg latency %lld s, max %lld s\n",
+           adaptive.wakeups, adaptive.changes,
+           (long long)(adaptive.total_latency_ms / adaptive.changes / 1000),
+           (long long)(adaptive.max_latency_ms / 1000));
+
+    if (adaptive.wakeups * 2 > fixed.wakeups) {
+        printf("adaptive interval saved too few wakeups\n");
+        failures++;
+    }
+    if (adaptive.max_latency_ms > MAX_MS) {
+        printf("level change seen too late\n");
+        failures++;
+    }
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("adaptive interval ok\n");
+    return 0;
+}
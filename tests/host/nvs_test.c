@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host-side test of replaying the NVS log after a reboot, on a fake NVS
+ * keeping the last record written to every ID.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#define CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES 192
+
+// The firmware is built with Zephyr's warnings, not -Wextra
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wsign-compare"
+#include "battery_history_nvs.c"
+
+// Reads taken by each bisection of the ID range
+#define BISECT_READS 8
+
+static uint8_t store[LOG_ID_BASE + LOG_RECORD_IDS][sizeof(struct log_record)];
+static size_t lengths[LOG_ID_BASE + LOG_RECORD_IDS];
+static int reads;
+
+int nvs_mount(struct nvs_fs *fs) { return 0; }
+
+int nvs_clear(struct nvs_fs *fs) {
+    memset(lengths, 0, sizeof(lengths));
+    return 0;
+}
+
+ssize_t nvs_write(struct nvs_fs *fs, uint16_t id, const void *data, size_t len) {
+    memcpy(store[id], data, len);
+    lengths[id] = len;
+    return len;
+}
+
+int nvs_delete(struct nvs_fs *fs, uint16_t id) {
+    lengths[id] = 0;
+    return 0;
+}
+
+ssize_t nvs_read(struct nvs_fs *fs, uint16_t id, void *data, size_t len) {
+    reads++;
+    if (lengths[id] == 0) {
+        return -ENOENT;
+    }
+    memcpy(data, store[id], MIN(len, lengths[id]));
+    return lengths[id];
+}
+
+static struct zmk_battery_history_entry restored[CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES];
+static int restored_count;
+static int discarded;
+
+void battery_history_restore_entry(const struct zmk_battery_history_entry *entry) {
+    if (restored_count < CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES) {
+        restored[restored_count] = *entry;
+    }
+    restored_count++;
+}
+
+void battery_history_count_discarded(void) { discarded++; }
+
+/**
+ * Write a log of total entries, per_record at a time, and replay it after a
+ * reboot, optionally with the second newest record corrupted
+ */
+static int check_replay(int total, int per_record, bool corrupt) {
+    struct zmk_battery_history_entry entries[LOG_RECORD_ENTRIES];
+    uint32_t timestamp = 1000;
+
+    battery_history_backend.init();
+    battery_history_backend.clear();
+    for (int written = 0; written < total; written += per_record) {
+        int n = MIN(per_record, total - written);
+        for (int i = 0; i < n; i++) {
+            entries[i].timestamp = timestamp++;
+            entries[i].battery_level = 100 - (timestamp % 100);
+        }
+        battery_history_backend.append(written, entries, n);
+    }
+    int expected_record = next_record;
+    uint32_t expected_seq = next_seq;
+    int expected_count = MIN(total, CONFIG_ZMK_BATTERY_HISTORY_MAX_ENTRIES);
+    if (corrupt) {
+        int record = (next_record - 2 + LOG_RECORD_IDS) % LOG_RECORD_IDS;
+        store[LOG_ID_BASE + record][LOG_RECORD_HEADER_SIZE] ^= 0xff;
+        expected_count -= per_record;
+    }
+
+    // Reboot, only the log is left
+    next_record = 0;
+    next_seq = 0;
+    mounted = false;
+    restored_count = 0;
+    discarded = 0;
+    reads = 0;
+    battery_history_backend.init();
+    battery_history_backend.load();
+
+    int failures = 0;
+    if (next_record != expected_record || next_seq != expected_seq) {
+        printf("%d entries, %d per record: write position %d/%u, expected %d/%u\n", total,
+               per_record, next_record, (unsigned)next_seq, expected_record,
+               (unsigned)expected_seq);
+        failures++;
+    }
+    if (restored_count != expected_count || discarded != (corrupt ? 1 : 0)) {
+        printf("%d entries, %d per record%s: %d restored, %d discarded\n", total, per_record,
+               corrupt ? ", corrupt" : "", restored_count, discarded);
+        return failures + 1;
+    }
+    for (int i = 0; i < restored_count; i++) {
+        bool last = i == restored_count - 1;
+        if ((last && restored[i].timestamp != timestamp - 1) ||
+            (!last && restored[i + 1].timestamp <= restored[i].timestamp) ||
+            (!corrupt && !last && restored[i + 1].timestamp != restored[i].timestamp + 1)) {
+            printf("%d entries, %d per record%s: entry %d out of order\n", total, per_record,
+                   corrupt ? ", corrupt" : "", i);
+            failures++;
+            break;
+        }
+    }
+
+    // Two bisections and the records replayed, an empty log is scanned
+    int records = (expected_count + per_record - 1) / per_record + 1;
+    if (!corrupt && total > 0 && reads > records + 2 * (BISECT_READS + 1)) {
+        printf("%d entries, %d per record: %d reads\n", total, per_record, reads);
+        failures++;
+    }
+    return failures;
+}
+
+int main(void) {
+    static const int totals[] = {0, 1, 15, 100, 191, 192, 193, 500, 1000, 3000};
+    static const int per_records[] = {1, 5, 16};
+    int failures = 0;
+
+    for (int t = 0; t < (int)ARRAY_SIZE(totals); t++) {
+        for (int p = 0; p < (int)ARRAY_SIZE(per_records); p++) {
+            failures += check_replay(totals[t], per_records[p], false);
+            if (totals[t] >= 2 * per_records[p]) {
+                failures += check_replay(totals[t], per_records[p], true);
+            }
+        }
+    }
+
+    check_replay(3000, LOG_RECORD_ENTRIES, false);
+    printf("full log, %d entries per record: %d reads, %d for a scan\n", LOG_RECORD_ENTRIES,
+           reads, 2 * LOG_RECORD_IDS);
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("nvs log replay ok\n");
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host-side test of rebasing per-boot timestamps onto the timeline.
+ */
+
+#include <stdio.h>
+
+#include "battery_history_timeline.h"
+
+#define GAP BATTERY_HISTORY_REBASE_BOOT_GAP_SEC
+
+static int expect(const char *what, uint32_t actual, uint32_t expected) {
+    if (actual != expected) {
+        printf("%s: got %u, expected %u\n", what, (unsigned)actual, (unsigned)expected);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    struct battery_history_rebase rebase;
+    int failures = 0;
+
+    // Two boots, the second starting a minute after the last entry of the first
+    battery_history_rebase_init(&rebase);
+    failures += expect("first boot", battery_history_rebase_legacy(&rebase, 100), 100);
+    failures += expect("first boot", battery_history_rebase_legacy(&rebase, 400), 400);
+    failures += expect("second boot", battery_history_rebase_legacy(&rebase, 30), 400 + GAP + 30);
+    failures += expect("second boot", battery_history_rebase_legacy(&rebase, 330), 400 + GAP + 330);
+
+    // An 18 hour uptime wrapping the 16-bit timestamp keeps increasing
+    battery_history_rebase_init(&rebase);
+    uint32_t last = 0;
+    uint16_t raw = 0;
+    for (int i = 0; i < 300; i++, raw += 300) {
+        uint32_t ts = battery_history_rebase_legacy(&rebase, raw);
+        if (i > 0 && ts <= last) {
+            printf("wrap-around: %u after %u\n", (unsigned)ts, (unsigned)last);
+            failures++;
+            break;
+        }
+        last = ts;
+    }
+
+    // Timeline entries after the legacy ones are shifted only when they overlap
+    battery_history_rebase_init(&rebase);
+    battery_history_rebase_legacy(&rebase, 5000);
+    failures += expect("overlap", battery_history_rebase_current(&rebase, 200), 5000 + GAP);
+    failures += expect("overlap", battery_history_rebase_current(&rebase, 500), 5000 + GAP + 300);
+    battery_history_rebase_init(&rebase);
+    battery_history_rebase_legacy(&rebase, 5000);
+    failures += expect("no overlap", battery_history_rebase_current(&rebase, 90000), 90000);
+    failures += expect("no overlap", battery_history_rebase_last(&rebase), 90000);
+
+    // Only timeline entries are kept as they are
+    battery_history_rebase_init(&rebase);
+    failures += expect("current only", battery_history_rebase_current(&rebase, 7), 7);
+    failures += expect("current only", battery_history_rebase_current(&rebase, 70000), 70000);
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("timeline rebased\n");
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2026 cormoran
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Host-side replay of a noisy discharge through the millivolt filter, and
+ * round-trip test of the millivolt encoding.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "battery_history_voltage.h"
+
+#define MAX_RUN 32
+#define FULL_MV 4180
+#define EMPTY_MV 3600
+
+static uint32_t rng_state = 12345;
+
+static uint32_t next_random(void) {
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 16;
+}
+
+static int round_trip(const struct zmk_battery_history_voltage_sample *samples, int count) {
+    uint8_t buf[BATTERY_HISTORY_VOLTAGE_MAX_SIZE(MAX_RUN)];
+    struct zmk_battery_history_voltage_sample decoded[MAX_RUN];
+
+    int len = battery_history_voltage_encode(samples, count, buf, sizeof(buf));
+    if (len < 0 || len > (int)BATTERY_HISTORY_VOLTAGE_MAX_SIZE(count)) {
+        printf("encode failed: count=%d rc=%d\n", count, len);
+        return 1;
+    }
+    int n = battery_history_voltage_decode(buf, len, decoded, MAX_RUN);
+    if (n != count || memcmp(samples, decoded, count * sizeof(*samples)) != 0) {
+        printf("round-trip mismatch: count=%d decoded=%d\n", count, n);
+        return 1;
+    }
+    if (count > 1 && battery_history_voltage_decode(buf, len - 1, decoded, MAX_RUN) >= 0) {
+        printf("truncated run decoded: count=%d\n", count);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Voltage read at the given minute of a 3-day discharge, with a few
+ * millivolts of noise and an occasional sag of a reading taken while the
+ * radio transmits, at most one within any three readings
+ */
+static uint16_t read_millivolts(int minute, double *actual, int *since_sag) {
+    *actual = FULL_MV - (double)minute * (FULL_MV - EMPTY_MV) / (3 * 24 * 60);
+    double noise = ((int)(next_random() % 801) - 400) / 100.0;
+    bool sag = *since_sag >= 2 && next_random() % 20 == 0;
+    *since_sag = sag ? 0 : *since_sag + 1;
+    return (uint16_t)(*actual + noise + 0.5) - (sag ? 60 + next_random() % 60 : 0);
+}
+
+int main(void) {
+    struct zmk_battery_history_voltage_sample samples[MAX_RUN];
+    int failures = 0;
+
+    // Typical discharge: 4 minute steps, dropping a few millivolts at a time
+    for (int i = 0; i < MAX_RUN; i++) {
+        samples[i].timestamp = 240 * (i + 1);
+        samples[i].millivolts = 4100 - 4 * i;
+    }
+    for (int count = 1; count <= MAX_RUN; count++) {
+        failures += round_trip(samples, count);
+    }
+    uint8_t buf[BATTERY_HISTORY_VOLTAGE_MAX_SIZE(MAX_RUN)];
+    int typical = battery_history_voltage_encode(samples, MAX_RUN, buf, sizeof(buf));
+    printf("typical run: %d samples in %d bytes\n", MAX_RUN, typical);
+    if (typical > BATTERY_HISTORY_VOLTAGE_HEADER_SIZE + (MAX_RUN - 1) * 3) {
+        printf("typical samples take more than 3 bytes\n");
+        failures++;
+    }
+
+    // Random and extreme deltas, including timestamps that wrap
+    for (int round = 0; round < 200; round++) {
+        int count = 1 + next_random() % MAX_RUN;
+        for (int i = 0; i < count; i++) {
+            samples[i].timestamp = round % 2 ? next_random() << 16 | next_random()
+                                             : 0xfffff000u + (uint32_t)i * 300;
+            samples[i].millivolts = round % 3 ? next_random() : (i % 2 ? 0xffff : 0);
+        }
+        failures += round_trip(samples, count);
+    }
+    if (battery_history_voltage_encode(samples, MAX_RUN, buf, MAX_RUN) >= 0) {
+        printf("encode overran a short buffer\n");
+        failures++;
+    }
+
+    // Single sags are dropped by the median
+    struct battery_history_voltage_filter filter;
+    battery_history_voltage_filter_init(&filter, 0);
+    battery_history_voltage_filter_update(&filter, 3900);
+    battery_history_voltage_filter_update(&filter, 3900);
+    if (battery_history_voltage_filter_update(&filter, 3800) != 3900 ||
+        battery_history_voltage_filter_update(&filter, 3900) != 3900) {
+        printf("median let a sag through\n");
+        failures++;
+    }
+
+    // Replay: the filtered voltage has to resolve well below one percent
+    double one_percent = (FULL_MV - EMPTY_MV) / 100.0;
+    double raw_error = 0, max_error = 0, total_error = 0;
+    int readings = 0, since_sag = 0;
+    battery_history_voltage_filter_init(&filter, 1);
+    for (int minute = 0; minute < 3 * 24 * 60; minute += 5, readings++) {
+        double actual;
+        uint16_t reading = read_millivolts(minute, &actual, &since_sag);
+        uint16_t filtered = battery_history_voltage_filter_update(&filter, reading);
+
+        double error = reading > actual ? reading - actual : actual - reading;
+        raw_error = error > raw_error ? error : raw_error;
+        error = filtered > actual ? filtered - actual : actual - filtered;
+        max_error = error > max_error ? error : max_error;
+        total_error += error;
+    }
+    printf("noisy trace: max error %.1f mV unfiltered, %.1f mV filtered (mean %.1f mV), "
+           "1%% is %.1f mV\n",
+           raw_error, max_error, total_error / readings, one_percent);
+    if (max_error >= one_percent || total_error / readings >= one_percent / 2) {
+        printf("filtered voltage does not resolve a percent\n");
+        failures++;
+    }
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("millivolts ok\n");
+    return 0;
+}
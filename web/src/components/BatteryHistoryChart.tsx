@@ -7,6 +7,7 @@
  * - Hover tooltip for data points
  * - Responsive design with dark mode support
  * - Color-coded battery levels (green/yellow/red)
+ * - Dashed markers where the device booted
  */
 
 import { useState, useMemo } from "react";
@@ -16,6 +17,8 @@ import "./BatteryHistoryChart.css";
 interface BatteryHistoryChartProps {
   entries: BatteryHistoryEntry[];
   startTimestamp?: number;
+  // Timeline times at which boot sessions started
+  sessionStarts?: number[];
 }
 
 interface TooltipData {
@@ -66,6 +69,7 @@ function getBatteryColorClass(level: number): string {
 export function BatteryHistoryChart({
   entries,
   startTimestamp,
+  sessionStarts,
 }: BatteryHistoryChartProps) {
   const [tooltip, setTooltip] = useState<TooltipData | null>(null);
 
@@ -79,41 +83,21 @@ export function BatteryHistoryChart({
   const innerWidth = chartWidth - padding.left - padding.right;
   const innerHeight = chartHeight - padding.top - padding.bottom;
 
-  const mappedEntries = useMemo(() => {
-    const newEntries = new Array<BatteryHistoryEntry>(entries.length);
-    entries.reduce((timestampOffset, entry, i) => {
-      // Ensure timestamps are strictly increasing by at least 60s
-      // Since timestamp resets at device reboot, we adjust accordingly
-
-      const timestamp = (() => {
-        if (i > 0 && entry.timestamp < entries[i - 1].timestamp) {
-          timestampOffset = entries[i - 1].timestamp + 60;
-        }
-        return entry.timestamp + timestampOffset;
-      })();
-      newEntries[i] = {
-        ...entry,
-        timestamp: timestamp,
-      };
-      return timestampOffset;
-    }, 0);
-    return newEntries;
-  }, [entries]);
-
   // Calculate chart data
   const chartData = useMemo(() => {
-    if (mappedEntries.length === 0) {
+    if (entries.length === 0) {
       return {
         points: [],
         pathData: "",
         areaData: "",
         xLabels: [],
+        sessionMarkers: [],
         yLabels: [0, 25, 50, 75, 100],
       };
     }
 
-    const maxTimestamp = Math.max(...mappedEntries.map((e) => e.timestamp));
-    const minTimestamp = Math.min(...mappedEntries.map((e) => e.timestamp));
+    const maxTimestamp = Math.max(...entries.map((e) => e.timestamp));
+    const minTimestamp = Math.min(...entries.map((e) => e.timestamp));
     const timeRange = maxTimestamp - minTimestamp || 1;
 
     // Scale functions
@@ -123,7 +107,7 @@ export function BatteryHistoryChart({
       padding.top + ((100 - level) / 100) * innerHeight;
 
     // Generate points
-    const points = mappedEntries.map((entry, index) => ({
+    const points = entries.map((entry, index) => ({
       x: scaleX(entry.timestamp),
       y: scaleY(entry.batteryLevel),
       entry,
@@ -142,16 +126,13 @@ export function BatteryHistoryChart({
 
     // X-axis labels (time)
     const xLabels: { x: number; label: string }[] = [];
-    const labelCount = Math.min(6, mappedEntries.length);
-    if (mappedEntries.length > 0) {
+    const labelCount = Math.min(6, entries.length);
+    if (entries.length > 0) {
       for (let i = 0; i < labelCount; i++) {
-        const idx = Math.floor(
-          (i * (mappedEntries.length - 1)) / (labelCount - 1)
-        );
-        const entry = mappedEntries[idx];
+        const idx = Math.floor((i * (entries.length - 1)) / (labelCount - 1));
+        const entry = entries[idx];
         if (entry) {
-          const now =
-            startTimestamp || mappedEntries[mappedEntries.length - 1].timestamp;
+          const now = startTimestamp || entries[entries.length - 1].timestamp;
           const ago = now - entry.timestamp;
           xLabels.push({
             x: scaleX(entry.timestamp),
@@ -161,16 +142,29 @@ export function BatteryHistoryChart({
       }
     }
 
+    // Sessions that started within the charted time range
+    const sessionMarkers = (sessionStarts ?? [])
+      .filter((start) => start > minTimestamp && start <= maxTimestamp)
+      .map(scaleX);
+
     return {
       points,
       pathData,
       areaData,
       xLabels,
+      sessionMarkers,
       yLabels: [0, 25, 50, 75, 100],
     };
-  }, [mappedEntries, innerWidth, innerHeight, padding, startTimestamp]);
-
-  if (mappedEntries.length === 0) {
+  }, [
+    entries,
+    innerWidth,
+    innerHeight,
+    padding,
+    startTimestamp,
+    sessionStarts,
+  ]);
+
+  if (entries.length === 0) {
     return (
       <div className="chart-empty">
         <div className="chart-empty-icon">📊</div>
@@ -254,6 +248,18 @@ export function BatteryHistoryChart({
           </text>
         ))}
 
+        {/* Session markers */}
+        {chartData.sessionMarkers.map((x, i) => (
+          <line
+            key={i}
+            x1={x}
+            y1={padding.top}
+            x2={x}
+            y2={padding.top + innerHeight}
+            className="session-marker"
+          />
+        ))}
+
         {/* Area fill */}
         <path
           d={chartData.areaData}
@@ -318,8 +324,7 @@ export function BatteryHistoryChart({
           </div>
           <div className="tooltip-time">
             {formatTimestamp(
-              (startTimestamp ||
-                mappedEntries[mappedEntries.length - 1].timestamp) -
+              (startTimestamp || entries[entries.length - 1].timestamp) -
                 tooltip.entry.timestamp
             )}
           </div>
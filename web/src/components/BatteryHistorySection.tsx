@@ -14,6 +14,7 @@ import {
   Request,
   Response,
   GetBatteryHistoryResponse,
+  BootSession,
 } from "../proto/zmk/battery_history/battery_history";
 import { BatteryHistoryChart } from "./BatteryHistoryChart";
 import { BatteryIndicator } from "./BatteryIndicator";
@@ -24,6 +25,7 @@ export const BATTERY_HISTORY_SUBSYSTEM = "zmk__battery_history";
 
 interface BatteryHistoryState {
   data: GetBatteryHistoryResponse | null;
+  sessions: BootSession[];
   isLoading: boolean;
   error: string | null;
   lastFetched: Date | null;
@@ -33,6 +35,7 @@ export function BatteryHistorySection() {
   const zmkApp = useContext(ZMKAppContext);
   const [state, setState] = useState<BatteryHistoryState>({
     data: null,
+    sessions: [],
     isLoading: false,
     error: null,
     lastFetched: null,
@@ -54,18 +57,22 @@ export function BatteryHistorySection() {
         subsystem.index
       );
 
-      // Create the request
-      const request = Request.create({
-        getHistory: {
-          includeMetadata: true,
-        },
-      });
-
-      // Encode and send the request
-      const payload = Request.encode(request).finish();
-      const responsePayload = await service.callRPC(payload);
+      // Fetch the history page by page, starting from the oldest entry
+      let data: GetBatteryHistoryResponse | null = null;
+      let offset = 0;
+      for (;;) {
+        const request = Request.create({
+          getHistory: {
+            includeMetadata: data === null,
+            offset,
+          },
+        });
+
+        // Encode and send the request
+        const payload = Request.encode(request).finish();
+        const responsePayload = await service.callRPC(payload);
+        if (!responsePayload) break;
 
-      if (responsePayload) {
         const resp = Response.decode(responsePayload);
         console.log("Battery history response:", resp);
 
@@ -75,14 +82,43 @@ export function BatteryHistorySection() {
             isLoading: false,
             error: resp.error?.message || "Unknown error",
           }));
-        } else if (resp.getHistory) {
-          setState({
-            data: resp.getHistory,
-            isLoading: false,
-            error: null,
-            lastFetched: new Date(),
-          });
+          return;
         }
+        if (!resp.getHistory) break;
+
+        const page = resp.getHistory;
+        data = data
+          ? { ...data, entries: [...data.entries, ...page.entries] }
+          : page;
+
+        // Firmware without paging leaves totalEntries at 0
+        if (page.nextOffset <= offset || page.nextOffset >= page.totalEntries) {
+          break;
+        }
+        offset = page.nextOffset;
+      }
+
+      // Boot sessions split the history, older firmware has none
+      let sessions: BootSession[] = [];
+      if (data) {
+        const payload = Request.encode(
+          Request.create({ getSessions: {} })
+        ).finish();
+        const responsePayload = await service.callRPC(payload);
+        if (responsePayload) {
+          sessions =
+            Response.decode(responsePayload).getSessions?.sessions ?? [];
+        }
+      }
+
+      if (data) {
+        setState({
+          data,
+          sessions,
+          isLoading: false,
+          error: null,
+          lastFetched: new Date(),
+        });
       }
     } catch (error) {
       console.error("Failed to fetch battery history:", error);
@@ -170,7 +206,7 @@ export function BatteryHistorySection() {
     );
   }
 
-  const { data, isLoading, error, lastFetched } = state;
+  const { data, sessions, isLoading, error, lastFetched } = state;
 
   return (
     <section className="card battery-section">
@@ -234,6 +270,7 @@ export function BatteryHistorySection() {
         <h3>Battery Level Over Time</h3>
         <BatteryHistoryChart
           entries={data?.entries ?? []}
+          sessionStarts={sessions.map((s) => s.start)}
         />
       </div>
 